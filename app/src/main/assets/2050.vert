@@ -20,13 +20,13 @@
 
 precision mediump float;
 
-attribute vec2 vert_pos;
-attribute vec2 ball_pos;
-attribute float radius;
-attribute vec3 vert_color;
+attribute vec2 ball_pos; // normalized to win_size
+attribute float size;
+attribute float corner; // which corner of the triangle around the ball this is: 0, 1, or 2
 
 uniform mat3 projection;
 uniform float win_size;
+uniform vec4 palette[32]; // color (rgb) and radius (a) for each ball size
 varying float border_size;
 varying float pixel_size;
 
@@ -35,12 +35,20 @@ varying vec2 center;
 varying float frag_radius;
 
 const float border_thickness = 2.0;
+const float corner_angle = 2.0943951; // 2 pi / 3
 
 void main()
 {
-    color = vert_color;
-    gl_Position = vec4((projection * vec3(vert_pos * 2.0 * radius + ball_pos, 1.0)).xy, 0.0, 1.0);
-    center = ball_pos;
+    vec4 entry = palette[int(size)];
+    color = entry.rgb;
+    float radius = entry.a;
+
+    // equilateral triangle, pointing up
+    float angle = (corner - 1.0) * corner_angle;
+    vec2 vert_pos = vec2(sin(angle), cos(angle));
+
+    center = ball_pos * win_size;
+    gl_Position = vec4((projection * vec3(vert_pos * 2.0 * radius + center, 1.0)).xy, 0.0, 1.0);
     frag_radius = radius;
     border_size = border_thickness / frag_radius;
     pixel_size = 1.0 / win_size;
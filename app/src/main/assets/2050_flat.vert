@@ -0,0 +1,41 @@
+// Copyright 2022 Matthew Chandler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+precision mediump float;
+
+// cheapest level of detail: a flat disc as a single point sprite, for balls only a few pixels across
+attribute vec2 ball_pos; // normalized to win_size
+attribute float size;
+
+uniform mat3 projection;
+uniform vec2 screen_size;
+uniform float win_size;
+uniform vec4 palette[32]; // color (rgb) and radius (a) for each ball size
+
+varying vec3 color;
+
+void main()
+{
+    vec4 entry = palette[int(size)];
+    color = entry.rgb;
+
+    gl_Position = vec4((projection * vec3(ball_pos * win_size, 1.0)).xy, 0.0, 1.0);
+    gl_PointSize = max(entry.a * projection[0][0] * screen_size.x, 1.0);
+}
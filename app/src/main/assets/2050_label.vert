@@ -0,0 +1,46 @@
+// Copyright 2022 Matthew Chandler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+precision highp float;
+
+// glyph quads for every ball label. Scale and rotation are applied here, so resizing is just a uniform change
+attribute vec2 center; // label center in pixels, origin at top left
+attribute vec2 offset; // glyph corner relative to center, in atlas pixels
+attribute vec2 tex_coord;
+attribute vec4 color;
+
+uniform vec2 screen_size;
+uniform float scale; // screen pixels per atlas pixel
+uniform vec2 rotation; // cos, sin of the label angle
+
+varying vec2 frag_tex_coord;
+varying vec4 frag_color;
+
+void main()
+{
+    frag_tex_coord = tex_coord;
+    frag_color = color;
+
+    vec2 scaled = scale * offset;
+    vec2 pos = center + vec2(rotation.x * scaled.x - rotation.y * scaled.y, rotation.y * scaled.x + rotation.x * scaled.y);
+
+    vec2 ndc = 2.0 * pos / screen_size - vec2(1.0);
+    gl_Position = vec4(ndc.x, -ndc.y, 0.0, 1.0);
+}
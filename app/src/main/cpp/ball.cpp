@@ -38,14 +38,14 @@ glm::vec2 rand_circle(float radius)
 
 void Ball::update_size()
 {
-    radius = size * 10.0f;
+    radius = radius_for_size(size);
     mass = 4.0f / 3.0f * pi * std::pow(radius, 3.0f);
-    color = ball_colors[ball_color_index(size, static_cast<int>(std::size(ball_colors)))];
+    color = (*ball_colors)[ball_color_index(size, static_cast<int>(std::size(*ball_colors)))];
 
     text_color = calc_text_color(color);
 }
 
-Ball::Ball(float win_size, const std::vector<glm::vec4> & ball_colors, const nlohmann::json & data): ball_colors(ball_colors)
+Ball::Ball(float win_size, const std::vector<glm::vec4> & ball_colors, const nlohmann::json & data): ball_colors(&ball_colors)
 {
     if(data.empty())
     {
@@ -58,6 +58,13 @@ Ball::Ball(float win_size, const std::vector<glm::vec4> & ball_colors, const nlo
     {
         deserialize(data);
     }
+    drawn_pos = pos;
+    update_size();
+}
+
+Ball::Ball(const std::vector<glm::vec4> & ball_colors, int size, const glm::vec2 & pos, const glm::vec2 & vel):
+    size(size), pos(pos), vel(vel), drawn_pos(pos), ball_colors(&ball_colors)
+{
     update_size();
 }
 
@@ -99,7 +106,8 @@ void Ball::physics_step(float dt, float win_size, const glm::vec2 & grav_vec, fl
     }
 }
 
-Ball::Collision collide_balls(Ball & ball, Ball & other, float e)
+template<bool can_merge>
+Ball::Collision Ball::collide(Ball & ball, Ball & other, float e)
 {
     glm::vec2 pos_diff = ball.pos - other.pos;
 
@@ -120,7 +128,7 @@ Ball::Collision collide_balls(Ball & ball, Ball & other, float e)
 
         float c = glm::dot(n, ball.vel - other.vel);
         // merge
-        if(ball.size == other.size)
+        if(can_merge && ball.size == other.size)
         {
             collision.merged = true;
 
@@ -152,6 +160,9 @@ Ball::Collision collide_balls(Ball & ball, Ball & other, float e)
     return {};
 }
 
+Ball::Collision collide_balls(Ball & ball, Ball & other, float e) { return Ball::collide<true>(ball, other, e); }
+Ball::Collision bounce_balls(Ball & ball, Ball & other, float e) { return Ball::collide<false>(ball, other, e); }
+
 void Ball::deserialize(const nlohmann::json & data)
 {
     if(data.find("size") != std::end(data))
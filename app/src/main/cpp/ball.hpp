@@ -32,21 +32,29 @@ private:
     float mass;
     glm::vec2 pos;
     glm::vec2 vel;
+    glm::vec2 drawn_pos; // position as of last render
     glm::vec4 color;
     glm::vec4 text_color;
 
     void update_size();
-    const std::vector<glm::vec4> & ball_colors;
+    const std::vector<glm::vec4> * ball_colors; // pointer rather than reference, so balls can be copy-assigned
 
 public:
     Ball(float win_size, const std::vector<glm::vec4> & ball_colors, const nlohmann::json & data = {});
+    Ball(const std::vector<glm::vec4> & ball_colors, int size, const glm::vec2 & pos, const glm::vec2 & vel);
+
+    static float radius_for_size(int size) { return size * 10.0f; }
 
     int get_size() const { return size; }
     float get_radius() const { return radius; }
     glm::vec2 get_pos() const { return pos; }
+    glm::vec2 get_vel() const { return vel; }
     glm::vec4 get_color() const { return color; }
     glm::vec4 get_text_color() const { return text_color; }
 
+    float get_motion() const { return glm::distance(pos, drawn_pos); }
+    void mark_drawn() { drawn_pos = pos; }
+
     void grow();
     void physics_step(float dt, float win_size, const glm::vec2 & grav_vec, float wall_damp);
 
@@ -55,6 +63,10 @@ public:
 
     struct Collision { bool collided = false; bool merged = false; float compression = 0.0f; };
     friend Collision collide_balls(Ball & ball, Ball & other, float e);
+    friend Collision bounce_balls(Ball & ball, Ball & other, float e); // same, except equal sizes bounce instead of merging
+
+private:
+    template<bool can_merge> static Collision collide(Ball & ball, Ball & other, float e);
 };
 
 #endif //INC_2050_BALL_HPP
@@ -20,9 +20,11 @@
 
 #include "engine.hpp"
 
+#include <cstring>
 #include <fstream>
 
 #include "log.hpp"
+#include "trace.hpp"
 
 using namespace std::chrono_literals;
 
@@ -74,6 +76,91 @@ void Engine::destroy_egl()
     context = EGL_NO_CONTEXT;
 }
 
+// unbind the context from this thread and destroy the window surface. The context, and everything in it, is kept for the next surface
+void Engine::release_surface()
+{
+    if(display == EGL_NO_DISPLAY)
+        return;
+
+    LOG_DEBUG_WRITE("Engine::release_surface", "Releasing surface");
+
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+
+    if(surface != EGL_NO_SURFACE)
+        eglDestroySurface(display, surface);
+    surface = EGL_NO_SURFACE;
+}
+
+// GL objects can only be deleted with their context current, and there's no window surface once the engine is destroyed.
+// Bind the context with no surface if EGL_KHR_surfaceless_context allows it, or to a 1x1 pbuffer otherwise
+bool Engine::make_current_without_window()
+{
+    if(display == EGL_NO_DISPLAY || context == EGL_NO_CONTEXT)
+        return false;
+
+    auto extensions = eglQueryString(display, EGL_EXTENSIONS);
+    if(extensions && std::strstr(extensions, "EGL_KHR_surfaceless_context"))
+    {
+        if(eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+            return true;
+        LOG_RING_PRINT(ANDROID_LOG_WARN, "Engine::make_current_without_window", "surfaceless eglMakeCurrent error: %s", eglGetErrorString(eglGetError()));
+    }
+
+    if(surface == EGL_NO_SURFACE)
+    {
+        // the window config might not support pbuffers. Any config with the same renderable type and channel sizes is compatible
+        auto pbuffer_config = config;
+        EGLint surface_type = 0, renderable_type = 0;
+        eglGetConfigAttrib(display, config, EGL_SURFACE_TYPE, &surface_type);
+        eglGetConfigAttrib(display, config, EGL_RENDERABLE_TYPE, &renderable_type);
+        if(!(surface_type & EGL_PBUFFER_BIT))
+        {
+            EGLint attribs[] =
+                    {
+                            EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+                            EGL_RENDERABLE_TYPE, renderable_type,
+                            EGL_RED_SIZE,   8,
+                            EGL_GREEN_SIZE, 8,
+                            EGL_BLUE_SIZE,  8,
+                            EGL_ALPHA_SIZE, 8,
+                            EGL_NONE,
+                    };
+            EGLint num_configs = 0;
+            if(!eglChooseConfig(display, attribs, &pbuffer_config, 1, &num_configs) || num_configs < 1)
+            {
+                LOG_ERROR_PRINT("Engine::make_current_without_window", "no pbuffer config: %s", eglGetErrorString(eglGetError()));
+                return false;
+            }
+        }
+
+        EGLint pbuffer_attribs[] = {EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE};
+        surface = eglCreatePbufferSurface(display, pbuffer_config, pbuffer_attribs); // destroyed by destroy_egl
+        if(surface == EGL_NO_SURFACE)
+        {
+            LOG_ERROR_PRINT("Engine::make_current_without_window", "eglCreatePbufferSurface error: %s", eglGetErrorString(eglGetError()));
+            return false;
+        }
+    }
+
+    if(!eglMakeCurrent(display, surface, surface, context))
+    {
+        LOG_ERROR_PRINT("Engine::make_current_without_window", "eglMakeCurrent error: %s", eglGetErrorString(eglGetError()));
+        return false;
+    }
+    return true;
+}
+
+// the context was lost (ie: after a power event), taking all of our GL resources with it. Start over from scratch
+void Engine::rebuild_egl()
+{
+    LOG_DEBUG_WRITE("Engine::rebuild_egl", "Context lost. Rebuilding");
+
+    world.destroy();
+    world_initialized = false;
+    destroy_egl();
+    init_egl();
+}
+
 bool Engine::init_egl()
 {
     display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
@@ -122,7 +209,7 @@ bool Engine::init_surface()
 
     if(height <= 0 || width <= 0)
     {
-        __android_log_print(ANDROID_LOG_WARN, "Engine::init_surface", "eglQuerySurface returned invalid size: %d x %d", width, height);
+        LOG_RING_PRINT(ANDROID_LOG_WARN, "Engine::init_surface", "eglQuerySurface returned invalid size: %d x %d", width, height);
         eglDestroySurface(display, surface);
         return false;
     }
@@ -132,34 +219,49 @@ bool Engine::init_surface()
 }
 bool Engine::init_context()
 {
-    EGLint attribs[] =
-            {
-                    EGL_SURFACE_TYPE, EGL_WINDOW_BIT,
-                    EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
-                    EGL_RED_SIZE,   8,
-                    EGL_GREEN_SIZE, 8,
-                    EGL_BLUE_SIZE,  8,
-                    EGL_ALPHA_SIZE, 8,
-                    EGL_NONE,
-            };
-    EGLint num_configs;
-    if(!eglChooseConfig(display, attribs, &config, 1, &num_configs))
+    // prefer GL ES 3 for instanced rendering, falling back to GL ES 2
+    const std::pair<int, EGLint> versions[] = {{3, EGL_OPENGL_ES3_BIT_KHR}, {2, EGL_OPENGL_ES2_BIT}};
+    for(auto & [version, renderable_type]: versions)
     {
-        LOG_ERROR_PRINT("Engine::init_context", "eglChooseConfig error: %s", eglGetErrorString(eglGetError()));
-        return false;
-    }
+        EGLint attribs[] =
+                {
+                        EGL_SURFACE_TYPE, EGL_WINDOW_BIT,
+                        EGL_RENDERABLE_TYPE, renderable_type,
+                        EGL_RED_SIZE,   8,
+                        EGL_GREEN_SIZE, 8,
+                        EGL_BLUE_SIZE,  8,
+                        EGL_ALPHA_SIZE, 8,
+                        EGL_NONE,
+                };
+        EGLint num_configs;
+        if(!eglChooseConfig(display, attribs, &config, 1, &num_configs))
+        {
+            // some drivers reject the ES 3 renderable type outright. Try the next version
+            LOG_RING_PRINT(ANDROID_LOG_WARN, "Engine::init_context", "eglChooseConfig error for GL ES %d: %s", version, eglGetErrorString(eglGetError()));
+            continue;
+        }
+        if(num_configs < 1)
+        {
+            LOG_DEBUG_PRINT("Engine::init_context", "no config for GL ES %d", version);
+            continue;
+        }
 
-    EGLint context_version[] = {EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE};
-    context = eglCreateContext(display, config, EGL_NO_CONTEXT, context_version);
-    if(context == EGL_NO_CONTEXT)
-    {
-        LOG_ERROR_PRINT("Engine::init_context", "eglCreateContext error: %s", eglGetErrorString(eglGetError()));
-        return false;
-    }
+        EGLint context_version[] = {EGL_CONTEXT_CLIENT_VERSION, version, EGL_NONE};
+        context = eglCreateContext(display, config, EGL_NO_CONTEXT, context_version);
+        if(context == EGL_NO_CONTEXT)
+        {
+            LOG_DEBUG_PRINT("Engine::init_context", "eglCreateContext error for GL ES %d: %s", version, eglGetErrorString(eglGetError()));
+            continue;
+        }
 
-    LOG_DEBUG_WRITE("Engine::init_context", "context created");
+        gl_version = version;
+        LOG_DEBUG_PRINT("Engine::init_context", "GL ES %d context created", gl_version);
 
-    return true;
+        return true;
+    }
+
+    LOG_ERROR_WRITE("Engine::init_context", "could not create context");
+    return false;
 }
 
 bool Engine::can_render()
@@ -204,21 +306,32 @@ bool Engine::can_render()
 
         if(!eglMakeCurrent(display, surface, surface, context))
         {
-            LOG_ERROR_PRINT("Engine::can_render", "eglMakeCurrent error: %s", eglGetErrorString(eglGetError()));
+            auto error = eglGetError();
+            LOG_ERROR_PRINT("Engine::can_render", "eglMakeCurrent error: %s", eglGetErrorString(error));
+            if(error == EGL_CONTEXT_LOST)
+                rebuild_egl();
             return false;
         }
 
-        LOG_DEBUG_WRITE("Engine::can_render", "set up to render");
+        LOG_DEBUG_PRINT("Engine::can_render", "set up to render (%s context)", world_initialized ? "reused" : "new");
 
+        // the context may be reused, so put the world's clear color back after this
+        GLfloat clear_color[4];
+        glGetFloatv(GL_COLOR_CLEAR_VALUE, clear_color);
         glClearColor(1.0f, 1.0f, 1.0f, 0.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glClearColor(clear_color[0], clear_color[1], clear_color[2], clear_color[3]);
 
         if(!eglSwapBuffers(display, surface))
         {
             LOG_ERROR_WRITE("Engine::can_render", "couldn't swap");
         }
 
-        world.init();
+        if(!world_initialized)
+        {
+            world.init(gl_version >= 3, data_path + "/shader_cache");
+            world_initialized = true;
+        }
         world.resize(width, height);
     }
 
@@ -228,23 +341,38 @@ bool Engine::can_render()
 void Engine::render_loop()
 {
     LOG_DEBUG_WRITE("Engine::render_loop", "start render loop");
+    TRACE_THREAD_NAME("render");
 
-    mutex.lock();
-    init_egl();
-    mutex.unlock();
+    Profiled_mutex::Lock lock(mutex, "render_loop");
+    if(display == EGL_NO_DISPLAY)
+        init_egl();
+    lock.unlock();
 
-    const std::chrono::duration<float> target_frametime{ 1.0f / 30.0f};
+    const std::chrono::duration<float> target_frametime{ 1.0f / (sandbox_mode ? 60.0f : 30.0f)};
 
     bool must_render = true;
     while(running)
     {
-        mutex.lock();
+        lock.lock();
         auto frame_start_time = std::chrono::steady_clock::now();
 
+        if(!has_surface)
+        {
+            // nothing to draw to. sleep until we get a surface back
+            if(surface != EGL_NO_SURFACE)
+                release_surface();
+            idle_wait(lock, render_idle, [this](){ return !running || has_surface; });
+            lock.unlock();
+            continue;
+        }
+
         if(!can_render())
         {
-            mutex.unlock();
-            std::this_thread::sleep_until(frame_start_time + target_frametime);
+            // retrying won't help until the surface changes, which wakes us through redraw. Keep any frame that was asked for
+            must_render |= redraw;
+            redraw = false;
+            idle_wait(lock, render_idle, [this](){ return !running || redraw; });
+            lock.unlock();
             continue;
         }
 
@@ -256,11 +384,15 @@ void Engine::render_loop()
 
         if(new_width <= 0 || new_height <= 0)
         {
-            mutex.unlock();
-            std::this_thread::sleep_until(frame_start_time + target_frametime);
+            // same as above. surfaceChanged reports the new size
+            must_render |= redraw;
+            redraw = false;
+            idle_wait(lock, render_idle, [this](){ return !running || redraw; });
+            lock.unlock();
             continue;
         }
 
+        bool resize_pending = false;
         if(new_width != width || new_height != height)
         {
             width = new_width; height = new_height;
@@ -274,119 +406,95 @@ void Engine::render_loop()
             int win_height = ANativeWindow_getHeight(win);
 
             if(win_width != width || win_height != height)
-                must_render = true;
+                must_render = resize_pending = true;
         }
 
-        if(!world.is_paused())
+        if(redraw || world.needs_render())
             must_render = true;
+        redraw = false;
 
         if(must_render)
         {
-            must_render = world.render();
+            world.render();
+            ++frame_stats.rendered;
 
-            if(!eglSwapBuffers(display, surface))
+            bool swapped;
+            {
+                TRACE_SCOPE("eglSwapBuffers");
+                swapped = eglSwapBuffers(display, surface);
+            }
+            if(!swapped)
+            {
+                auto error = eglGetError();
+                LOG_ERROR_PRINT("Engine::render_loop", "couldn't swap: %s", eglGetErrorString(error));
+                if(error == EGL_CONTEXT_LOST)
+                    rebuild_egl();
+            }
+            else if(first_frame_pending)
             {
-                LOG_ERROR_WRITE("Engine::render_loop", "couldn't swap");
+                first_frame_pending = false;
+                std::chrono::duration<float> time = std::chrono::steady_clock::now() - resume_time;
+                LOG_DEBUG_PRINT("Engine::render_loop", "resume to first frame: %.3f ms", 1000.0f * time.count());
             }
         }
-        mutex.unlock();
+        must_render = false;
+
+        if(!resize_pending)
+        {
+            // nothing on screen has visibly changed. sleep until the physics thread reports motion, or an event asks for a new frame
+            idle_wait(lock, render_idle, [this](){ return !running || redraw || !has_surface || world.needs_render(); });
+        }
+
+        lock.unlock();
         std::this_thread::sleep_until(frame_start_time + target_frametime);
     }
 
-    world.destroy();
-    destroy_egl();
+    world.log_render_stats();
+
+    // keep the context, so resuming doesn't need to rebuild everything. See ~Engine for the final teardown
+    release_surface();
 
     LOG_DEBUG_WRITE("Engine::render_loop", "end render loop");
 }
 
 void Engine::physics_loop()
 {
-    LOG_DEBUG_WRITE("Engine::physics_loop", "start physics loop");
-
-    if(gravity_mode)
-    {
-        sensor_queue = ASensorManager_createEventQueue(sensor_mgr, ALooper_prepare(ALOOPER_PREPARE_ALLOW_NON_CALLBACKS), sensor_ident, nullptr, nullptr);
-        if(!sensor_queue)
-            __android_log_assert("Could not prepare queue for gravity sensor", "Engine::physics_loop", nullptr);
-
-        accelerometer_sensor = ASensorManager_getDefaultSensor(sensor_mgr, ASENSOR_TYPE_ACCELEROMETER);
-
-        if(!accelerometer_sensor)
-            __android_log_assert("Could not get Accelerometer Sensor", "Engine::physics_loop", nullptr);
-
-        ASensorEventQueue_enableSensor(sensor_queue, accelerometer_sensor);
-    }
-
-    const std::chrono::duration<float> target_frametime{10ms};
-    auto last_frame_time = std::chrono::steady_clock::now() - target_frametime;
-
-    while(running)
-    {
-        mutex.lock();
-        auto frame_start_time = std::chrono::steady_clock::now();
-        auto dt = std::chrono::duration_cast<std::chrono::duration<float>>(frame_start_time - last_frame_time).count();
-        dt = std::min(dt, target_frametime.count() * 1.5f);
-        last_frame_time = frame_start_time;
-
-        if(gravity_mode)
-        {
-            int ident = ALooper_pollOnce(0, nullptr, nullptr, nullptr);
-            if(ident == sensor_ident)
-            {
-                ASensorEvent sensorEvent;
-                ASensorEventQueue_getEvents(sensor_queue, &sensorEvent, 1);
-                grav_sensor_vec.x =  sensorEvent.vector.x;
-                grav_sensor_vec.y = -sensorEvent.vector.y;
-
-                // reorient gravity to current screen rotation
-                switch(rotation)
-                {
-                case Rotation::ROTATION_0:
-                    break;
-                case Rotation::ROTATION_90:
-                    grav_sensor_vec = {grav_sensor_vec.y, -grav_sensor_vec.x};
-                    break;
-                case Rotation::ROTATION_180:
-                    grav_sensor_vec = {-grav_sensor_vec.x, -grav_sensor_vec.y};
-                    break;
-                case Rotation::ROTATION_270:
-                    grav_sensor_vec = {-grav_sensor_vec.y, grav_sensor_vec.x};
-                    break;
-                }
-            }
-        }
-
-        world.physics_step(dt, grav_sensor_vec);
-
-        mutex.unlock();
-        std::this_thread::sleep_until(frame_start_time + target_frametime);
-    }
-
+    std::unique_ptr<Gravity_stage> gravity;
     if(gravity_mode)
     {
-        if(ASensorEventQueue_disableSensor(sensor_queue, accelerometer_sensor) != 0)
-            __android_log_assert("Could not disable gravity sensor", "Engine::physics_loop", nullptr);
+        std::unique_ptr<Gravity_source> source;
+#ifndef NDEBUG
+        // play back a recorded trace instead of the real sensor, if one has been provided
+        auto trace = std::make_unique<Trace_source>(data_path + "/gravity_trace.txt");
+        if(!trace->empty())
+            source = std::move(trace);
+#endif
+        if(!source)
+            source = std::make_unique<Accelerometer_source>(sensor_mgr);
 
-        if(ASensorManager_destroyEventQueue(sensor_mgr, sensor_queue) != 0)
-            __android_log_assert("Could not destroy gravity sensor queue", "Engine::physics_loop", nullptr);
+        gravity = std::make_unique<Gravity_stage>(std::move(source), rotation);
     }
 
-    LOG_DEBUG_WRITE("Engine::physics_loop", "end physics loop");
+    // a sensor period in the past
+    Engine_core::physics_loop(gravity.get(), Accelerometer_source::sampling_period_us * 1000);
 }
 
-Engine::Engine(AAssetManager * asset_manager, const std::string & data_path, bool first_run, bool gravity_mode, Rotation rotation):
+Engine::Engine(AAssetManager * asset_manager, const std::string & data_path, bool first_run, bool gravity_mode, Rotation rotation, bool pressure_overlay, const Sandbox_config & sandbox):
+        Engine_core(asset_manager, gravity_mode, sandbox),
         data_path(data_path),
         gravity_mode(gravity_mode),
-        rotation(rotation),
-        world(asset_manager, gravity_mode)
+        sandbox_mode(sandbox.enabled),
+        rotation(rotation)
 {
-    std::ifstream savefile(data_path + "/save.json");
+    std::ifstream savefile(get_save_path());
     if(savefile)
     {
         nlohmann::json data;
         savefile>>data;
         world.deserialize(data, first_run);
     }
+    world.set_pressure_overlay(pressure_overlay);
+    publish_ui_data();
 
 #if __ANDROID_API__ >= __ANDROID_API_O__
     sensor_mgr = ASensorManager_getInstanceForPackage("2050");
@@ -397,23 +505,43 @@ Engine::Engine(AAssetManager * asset_manager, const std::string & data_path, boo
         __android_log_assert("Could not get ASensorManager", "Engine::Engine", nullptr);
 }
 
+Engine::~Engine()
+{
+    // if the context can't be made current, the GL objects are freed along with it instead
+    if(world_initialized)
+    {
+        if(make_current_without_window())
+            world.destroy();
+        else
+            LOG_RING_PRINT(ANDROID_LOG_WARN, "Engine::~Engine", "%s", "could not make the context current. GL objects are freed with it");
+    }
+
+    destroy_egl();
+}
+
 void Engine::resume() noexcept
 {
-    running = true;
+    resume_time = std::chrono::steady_clock::now();
+    first_frame_pending = true;
+    start_loops();
     render_thread = std::thread(&Engine::render_loop, this);
     physics_thread = std::thread(&Engine::physics_loop, this);
 }
 void Engine::pause() noexcept
 {
-    running = false;
+    stop_loops();
+
     render_thread.join();
     physics_thread.join();
+
+    log_stats();
 }
 void Engine::stop() noexcept
 {
+    TRACE_SCOPE("save");
     try
     {
-        std::ofstream savefile(data_path + "/save.json");
+        std::ofstream savefile(get_save_path());
         savefile<<world.serialize();
 
         LOG_DEBUG_WRITE("Engine::stop", "saved data");
@@ -435,54 +563,3 @@ void Engine::set_focus(bool focus) noexcept
     else
         pause_game();
 }
-
-void Engine::surface_changed(ANativeWindow *window) noexcept
-{
-    std::scoped_lock lock(mutex);
-    if(window)
-    {
-        LOG_DEBUG_PRINT("Engine::surface_changed", "surfaceChanged, with size: %d x %d", ANativeWindow_getWidth(window), ANativeWindow_getHeight(window));
-        has_surface = true;
-        win = window;
-    }
-    else
-    {
-        has_surface = false;
-        ANativeWindow_release(win);
-        win = nullptr;
-    }
-}
-
-void Engine::fling(float x, float y) noexcept
-{
-    std::scoped_lock lock(mutex);
-    world.fling(x, y);
-}
-
-void Engine::new_game() noexcept
-{
-    std::scoped_lock lock(mutex);
-    world.new_game();
-}
-
-void Engine::pause_game() noexcept
-{
-    std::scoped_lock lock(mutex);
-    world.pause();
-}
-void Engine::unpause() noexcept
-{
-    std::scoped_lock lock(mutex);
-    world.unpause();
-}
-bool Engine::is_paused() noexcept
-{
-    std::scoped_lock lock(mutex);
-    return world.is_paused();
-}
-
-World::UI_data Engine::get_ui_data() noexcept
-{
-    std::scoped_lock lock(mutex);
-    return world.get_ui_data();
-}
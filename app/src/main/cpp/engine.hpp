@@ -21,8 +21,8 @@
 #ifndef INC_2050_ENGINE_HPP
 #define INC_2050_ENGINE_HPP
 
-#include <atomic>
-#include <mutex>
+#include <chrono>
+#include <memory>
 #include <string>
 #include <thread>
 
@@ -31,44 +31,41 @@
 #include <android/sensor.h>
 
 #include <EGL/egl.h>
+#include <EGL/eglext.h>
 
-#include "world.hpp"
+#include "engine_core.hpp"
+#include "sensor.hpp"
 
-// Shadows android.View.Surface.ROTATION_*
-enum class Rotation: int{ROTATION_0, ROTATION_90, ROTATION_180, ROTATION_270};
-
-class Engine
+class Engine: public Engine_core
 {
 private:
-    ANativeWindow * win = nullptr;
     std::string data_path;
+    std::string get_save_path() const { return data_path + (sandbox_mode ? "/sandbox_save.json" : "/save.json"); }
 
     int width = 0, height = 0;
 
-    std::atomic<bool> has_surface = false;
-
     EGLDisplay display = EGL_NO_DISPLAY;
     EGLSurface surface = EGL_NO_SURFACE;
     EGLContext context = EGL_NO_CONTEXT;
     EGLConfig config;
+    int gl_version = 0; // major version of the current context
+    bool world_initialized = false; // world's GL resources belong to context. Kept across pause / resume until the context is lost
+
+    std::chrono::steady_clock::time_point resume_time;
+    bool first_frame_pending = false;
 
     const bool gravity_mode = false;
+    const bool sandbox_mode = false; // renders at 60 fps, and saves to its own file so a sandbox session doesn't overwrite the game
     const Rotation rotation = Rotation::ROTATION_0;
     ASensorManager * sensor_mgr;
-    const ASensor * accelerometer_sensor;
-    ASensorEventQueue * sensor_queue;
-    const int sensor_ident = 1;
-    glm::vec2 grav_sensor_vec {0.0f, -1.0f};
 
     std::thread render_thread;
     std::thread physics_thread;
-    std::atomic<bool> running = false;
-
-    World world;
-
-    std::mutex mutex;
 
     void destroy_egl();
+    void release_surface();
+    bool make_current_without_window();
+    void rebuild_egl();
     bool init_egl();
     bool init_context();
     bool init_surface();
@@ -78,22 +75,16 @@ private:
     void physics_loop();
 
 public:
-    Engine(AAssetManager * asset_manager, const std::string & data_path, bool first_run, bool gravity_mode, Rotation rotation);
+    Engine(AAssetManager * asset_manager, const std::string & data_path, bool first_run, bool gravity_mode, Rotation rotation, bool pressure_overlay = false, const Sandbox_config & sandbox = {});
+    ~Engine();
+    Engine(const Engine &) = delete;
+    Engine & operator=(const Engine &) = delete;
 
     void resume() noexcept;
     void pause() noexcept;
     void stop() noexcept;
 
     void set_focus(bool focus) noexcept;
-    void surface_changed(ANativeWindow * window) noexcept;
-
-    void fling(float x, float y) noexcept;
-
-    void new_game() noexcept;
-    void pause_game() noexcept;
-    void unpause() noexcept;
-    bool is_paused() noexcept;
-    World::UI_data get_ui_data() noexcept;
 };
 
 
@@ -0,0 +1,201 @@
+// Copyright 2022 Matthew Chandler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#include "engine_core.hpp"
+
+#include <thread>
+
+#include "jni.hpp"
+#include "log.hpp"
+#include "trace.hpp"
+
+using namespace std::chrono_literals;
+
+float Engine_core::Idle_stats::wakeups_per_sec() const
+{
+    return idle_time.count() > 0.0f ? static_cast<float>(wakeups) / idle_time.count() : 0.0f;
+}
+
+void Engine_core::publish_ui_data()
+{
+    ui_data.write(world.get_ui_data());
+}
+
+void Engine_core::wake_loops()
+{
+    redraw = true;
+    state_cv.notify_all();
+}
+
+void Engine_core::log_stats()
+{
+    LOG_DEBUG_PRINT("Engine::pause", "%s: %lu wakeups in %.1fs idle (%.3f / s)", render_idle.loop_name, render_idle.wakeups, render_idle.idle_time.count(), render_idle.wakeups_per_sec());
+    LOG_DEBUG_PRINT("Engine::pause", "%s: %lu wakeups in %.1fs idle (%.3f / s)", physics_idle.loop_name, physics_idle.wakeups, physics_idle.idle_time.count(), physics_idle.wakeups_per_sec());
+    LOG_DEBUG_PRINT("Engine::pause", "frames rendered: %lu, physics ticks skipped: %lu", frame_stats.rendered, frame_stats.skipped);
+    for(auto [name, ticks]: {std::pair{"physics ticks", &physics_ticks}, std::pair{"physics ticks with events", &event_ticks}})
+    {
+        if(ticks->get_count() > 0)
+            LOG_DEBUG_PRINT("Engine::pause", "%s: %lu, mean %.3f ms, p99 < %.3f ms, max %.3f ms", name, ticks->get_count(), ticks->mean_ms(), ticks->percentile_ms(0.99f), ticks->max_ms());
+    }
+    mutex.log_report("Engine::pause");
+}
+
+Engine_core::Engine_core(AAssetManager * asset_manager, bool gravity_mode, const Sandbox_config & sandbox):
+        world(asset_manager, gravity_mode, sandbox)
+{
+    publish_ui_data();
+}
+
+void Engine_core::start_loops() noexcept
+{
+    running = true;
+}
+void Engine_core::stop_loops() noexcept
+{
+    {
+        Profiled_mutex::Lock lock(mutex, "pause");
+        running = false;
+    }
+    state_cv.notify_all();
+}
+
+void Engine_core::physics_loop(Gravity_stage * gravity, std::int64_t gravity_lag_ns)
+{
+    LOG_DEBUG_WRITE("Engine::physics_loop", "start physics loop");
+    TRACE_THREAD_NAME("physics");
+
+    if(gravity)
+        gravity->enable();
+
+    const std::chrono::duration<float> target_frametime{10ms};
+    auto last_frame_time = std::chrono::steady_clock::now() - target_frametime;
+
+    while(running)
+    {
+        Profiled_mutex::Lock lock(mutex, "physics_loop");
+
+        if(world.is_idle())
+        {
+            // nothing to simulate. turn off the sensor and sleep until unpaused or a new game is started
+            if(gravity)
+                gravity->disable();
+
+            idle_wait(lock, physics_idle, [this](){ return !running || !world.is_idle(); });
+            lock.unlock();
+
+            if(gravity)
+                gravity->enable();
+
+            last_frame_time = std::chrono::steady_clock::now() - target_frametime;
+            continue;
+        }
+
+        auto frame_start_time = std::chrono::steady_clock::now();
+        auto dt = std::chrono::duration_cast<std::chrono::duration<float>>(frame_start_time - last_frame_time).count();
+        dt = std::min(dt, target_frametime.count() * 1.5f);
+        last_frame_time = frame_start_time;
+
+        if(gravity)
+        {
+            // sample in the past, so we're interpolating between readings rather than extrapolating
+            gravity->update();
+            grav_sensor_vec = gravity->get(sensor_clock_now() - gravity_lag_ns);
+        }
+
+        auto events_posted = get_posted_event_count();
+        auto step_start_time = std::chrono::steady_clock::now();
+
+        world.physics_step(dt, grav_sensor_vec);
+        publish_ui_data();
+
+        auto step_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - step_start_time).count();
+        (get_posted_event_count() != events_posted ? event_ticks : physics_ticks).add(static_cast<std::uint64_t>(step_ns));
+
+        if(world.needs_render())
+            state_cv.notify_all();
+        else
+            ++frame_stats.skipped;
+
+        lock.unlock();
+        std::this_thread::sleep_until(frame_start_time + target_frametime);
+    }
+
+    LOG_DEBUG_WRITE("Engine::physics_loop", "end physics loop");
+}
+
+void Engine_core::surface_changed(ANativeWindow *window) noexcept
+{
+    Profiled_mutex::Lock lock(mutex, "surface_changed");
+    if(window)
+    {
+        LOG_DEBUG_PRINT("Engine::surface_changed", "surfaceChanged, with size: %d x %d", ANativeWindow_getWidth(window), ANativeWindow_getHeight(window));
+        has_surface = true;
+        win = window;
+    }
+    else
+    {
+        has_surface = false;
+        ANativeWindow_release(win);
+        win = nullptr;
+    }
+    wake_loops();
+}
+
+void Engine_core::fling(float x, float y) noexcept
+{
+    Profiled_mutex::Lock lock(mutex, "fling");
+    world.fling(x, y);
+    wake_loops();
+}
+
+void Engine_core::new_game() noexcept
+{
+    Profiled_mutex::Lock lock(mutex, "new_game");
+    world.new_game();
+    publish_ui_data();
+    wake_loops();
+}
+
+void Engine_core::pause_game() noexcept
+{
+    Profiled_mutex::Lock lock(mutex, "pause_game");
+    world.pause();
+}
+void Engine_core::unpause() noexcept
+{
+    Profiled_mutex::Lock lock(mutex, "unpause");
+    world.unpause();
+    wake_loops();
+}
+bool Engine_core::is_paused() noexcept
+{
+    Profiled_mutex::Lock lock(mutex, "is_paused");
+    return world.is_paused();
+}
+
+Engine_core::Frame_stats Engine_core::get_frame_stats() noexcept
+{
+    Profiled_mutex::Lock lock(mutex, "get_frame_stats");
+    return frame_stats;
+}
+
+std::vector<Profiled_mutex::Site_stats> Engine_core::get_lock_report() noexcept
+{
+    return mutex.get_report();
+}
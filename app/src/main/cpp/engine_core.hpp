@@ -0,0 +1,139 @@
+// Copyright 2022 Matthew Chandler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#ifndef INC_2050_ENGINE_CORE_HPP
+#define INC_2050_ENGINE_CORE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <vector>
+
+#include <android/asset_manager.h>
+#include <android/native_window.h>
+
+#include "gravity.hpp"
+#include "histogram.hpp"
+#include "profiled_mutex.hpp"
+#include "seqlock.hpp"
+#include "world.hpp"
+
+// the part of Engine shared between its threads and the UI thread: the world, the mutex that guards it, the UI data published
+// from it, the locked entry points, and the physics loop. Nothing here needs EGL or sensors, so tools/headless can drive the
+// same call sites the app does. Engine adds EGL, the render loop, sensors and saving on top
+class Engine_core
+{
+public:
+    struct Frame_stats
+    {
+        unsigned long rendered = 0;
+        unsigned long skipped = 0; // physics ticks that moved nothing visibly, so didn't wake the render loop
+    };
+
+protected:
+    ANativeWindow * win = nullptr;
+    std::atomic<bool> has_surface = false;
+    std::atomic<bool> running = false;
+
+    World world;
+    glm::vec2 grav_sensor_vec {0.0f, -1.0f};
+
+    Profiled_mutex mutex;
+    std::condition_variable_any state_cv; // signalled whenever something happens that an idle loop should wake for
+    bool redraw = true; // set by events that need a new frame drawn, even when the world is idle
+
+    // published by the physics thread (and by events that change it), read by the UI thread without locking
+    Seqlock<World::UI_data> ui_data;
+    void publish_ui_data(); // mutex must be held
+
+    // counts how often a loop wakes up while it has nothing to do. Should be ~0 / s
+    struct Idle_stats
+    {
+        const char * loop_name;
+        std::chrono::steady_clock::time_point idle_start;
+        std::chrono::duration<float> idle_time{0.0f};
+        unsigned long wakeups = 0;
+
+        explicit Idle_stats(const char * loop_name): loop_name(loop_name) {}
+        float wakeups_per_sec() const;
+    };
+    Idle_stats render_idle{"render_loop"};
+    Idle_stats physics_idle{"physics_loop"};
+    Frame_stats frame_stats;
+
+    // physics step times, split by whether the step queued a call to MainActivity (game over, win, achievement)
+    Time_histogram physics_ticks;
+    Time_histogram event_ticks;
+
+    template<typename Pred>
+    void idle_wait(Profiled_mutex::Lock & lock, Idle_stats & stats, Pred pred);
+    void wake_loops();
+
+    void log_stats(); // after the loops have stopped
+
+public:
+    Engine_core(AAssetManager * asset_manager, bool gravity_mode, const Sandbox_config & sandbox = {});
+    Engine_core(const Engine_core &) = delete;
+    Engine_core & operator=(const Engine_core &) = delete;
+
+    // stop_loops wakes the loops and has them return. Their threads must be joined before they're started again
+    void start_loops() noexcept;
+    void stop_loops() noexcept;
+
+    // runs on the physics thread until stop_loops. Without gravity, gravity points down the screen. Otherwise it's sampled
+    // gravity_lag_ns in the past
+    void physics_loop(Gravity_stage * gravity, std::int64_t gravity_lag_ns);
+
+    void surface_changed(ANativeWindow * window) noexcept;
+
+    void fling(float x, float y) noexcept;
+
+    void new_game() noexcept;
+    void pause_game() noexcept;
+    void unpause() noexcept;
+    bool is_paused() noexcept;
+    // rendered is counted by the render loop, skipped by the physics loop. They tick at different rates (30 or 60 Hz vs
+    // 100 Hz), so compare each against its own loop's rate rather than against each other
+    Frame_stats get_frame_stats() noexcept;
+
+    // lock-free view of World::UI_data, for a direct ByteBuffer. Valid for the lifetime of the engine. See Seqlock for the layout
+    void * get_ui_data_buffer() noexcept { return ui_data.get_data(); }
+    constexpr static std::size_t get_ui_data_buffer_size() noexcept { return decltype(ui_data)::get_size(); }
+    World::UI_data read_ui_data() const noexcept { return ui_data.read(); }
+    std::vector<Profiled_mutex::Site_stats> get_lock_report() noexcept;
+};
+
+// block until pred is true. lock must be held on mutex
+template<typename Pred>
+void Engine_core::idle_wait(Profiled_mutex::Lock & lock, Idle_stats & stats, Pred pred)
+{
+    if(pred())
+        return;
+
+    stats.idle_start = std::chrono::steady_clock::now();
+    do
+    {
+        state_cv.wait(lock);
+        ++stats.wakeups;
+    } while(!pred());
+    stats.idle_time += std::chrono::steady_clock::now() - stats.idle_start;
+}
+
+#endif //INC_2050_ENGINE_CORE_HPP
@@ -0,0 +1,126 @@
+// Copyright 2022 Matthew Chandler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef INC_2050_EVENT_DISPATCHER_HPP
+#define INC_2050_EVENT_DISPATCHER_HPP
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "log.hpp"
+
+// a game_win, game_over or achievement call for MainActivity
+struct Game_event
+{
+    enum class Type {GAME_WIN, GAME_OVER, ACHIEVEMENT};
+
+    Type type;
+    int value;
+    bool new_high_score;
+};
+
+// queues Game_events and hands them to a Sender on its own thread, so the poster never waits on the call.
+// A Sender is constructed and destroyed on that thread (ie: to keep it attached to the JVM), and is called as sender(event).
+// No Android dependencies, so it can be built and measured on the host
+template<typename Sender>
+class Event_dispatcher
+{
+private:
+    std::mutex mutex;
+    std::condition_variable cv;
+
+    // ring buffer, so posting never allocates. Events come a few per game, so this only fills if the sender is stuck
+    constexpr static std::size_t max_queued = 16;
+    std::array<Game_event, max_queued> queue;
+    std::size_t queue_front = 0; // index into queue
+    std::size_t num_queued = 0;
+
+    bool running = false;
+    std::thread thread;
+    std::atomic<unsigned long> posted {0};
+
+    void run()
+    {
+        Sender sender;
+
+        std::unique_lock lock(mutex);
+        while(true)
+        {
+            cv.wait(lock, [this](){ return !running || num_queued > 0; });
+            if(num_queued == 0)
+                break; // stopped, and everything has been sent
+
+            auto event = queue[queue_front];
+            queue_front = (queue_front + 1) % max_queued;
+            --num_queued;
+            lock.unlock();
+
+            sender(event);
+
+            lock.lock();
+        }
+    }
+
+public:
+    void start()
+    {
+        running = true;
+        thread = std::thread(&Event_dispatcher::run, this);
+    }
+
+    // sends anything still queued before returning
+    void stop()
+    {
+        {
+            std::scoped_lock lock(mutex);
+            running = false;
+        }
+        cv.notify_one();
+        thread.join();
+    }
+
+    void post(Game_event::Type type, int value, bool new_high_score = false)
+    {
+        {
+            std::scoped_lock lock(mutex);
+            if(!running)
+            {
+                LOG_ERROR_WRITE("Event_dispatcher::post", "event posted while not running. dropped");
+                return;
+            }
+            if(num_queued == max_queued)
+            {
+                LOG_ERROR_WRITE("Event_dispatcher::post", "queue full. event dropped");
+                return;
+            }
+            queue[(queue_front + num_queued) % max_queued] = {type, value, new_high_score};
+            ++num_queued;
+        }
+        ++posted;
+        cv.notify_one();
+    }
+
+    unsigned long get_posted() const { return posted; }
+};
+
+#endif //INC_2050_EVENT_DISPATCHER_HPP
@@ -0,0 +1,166 @@
+// Copyright 2022 Matthew Chandler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "gpu_timer.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include <EGL/egl.h>
+#include <GLES2/gl2ext.h>
+
+#include "log.hpp"
+
+Gpu_timer::Gpu_timer()
+{
+    auto extensions = reinterpret_cast<const char *>(glGetString(GL_EXTENSIONS));
+    if(!extensions || !std::strstr(extensions, "GL_EXT_disjoint_timer_query"))
+    {
+        LOG_DEBUG_WRITE("Gpu_timer::Gpu_timer", "GL_EXT_disjoint_timer_query not supported. GPU pass timing disabled");
+        return;
+    }
+
+    gen_queries = reinterpret_cast<Gen_queries_fun>(eglGetProcAddress("glGenQueriesEXT"));
+    delete_queries = reinterpret_cast<Delete_queries_fun>(eglGetProcAddress("glDeleteQueriesEXT"));
+    begin_query = reinterpret_cast<Begin_query_fun>(eglGetProcAddress("glBeginQueryEXT"));
+    end_query = reinterpret_cast<End_query_fun>(eglGetProcAddress("glEndQueryEXT"));
+    get_query_objectuiv = reinterpret_cast<Get_query_objectuiv_fun>(eglGetProcAddress("glGetQueryObjectuivEXT"));
+    get_query_objectui64v = reinterpret_cast<Get_query_objectui64v_fun>(eglGetProcAddress("glGetQueryObjectui64vEXT"));
+
+    if(!gen_queries || !delete_queries || !begin_query || !end_query || !get_query_objectuiv || !get_query_objectui64v)
+    {
+        LOG_ERROR_WRITE("Gpu_timer::Gpu_timer", "GL_EXT_disjoint_timer_query is advertised, but missing functions. GPU pass timing disabled");
+        gen_queries = nullptr;
+        return;
+    }
+
+    for(auto & frame: frames)
+        gen_queries(static_cast<GLsizei>(std::size(frame.queries)), std::data(frame.queries));
+
+    // reading the disjoint flag clears it
+    GLint disjoint = 0;
+    glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+
+    LOG_DEBUG_WRITE("Gpu_timer::Gpu_timer", "GPU pass timing enabled");
+}
+
+Gpu_timer::~Gpu_timer()
+{
+    if(!is_supported())
+        return;
+
+    for(auto & frame: frames)
+        delete_queries(static_cast<GLsizei>(std::size(frame.queries)), std::data(frame.queries));
+}
+
+void Gpu_timer::collect()
+{
+    while(frames[read_frame].pending)
+    {
+        auto & frame = frames[read_frame];
+
+        // queries finish in order, so if the last one isn't ready, none of the later frames are either
+        for(auto i = num_passes; i-- > 0;)
+        {
+            if(!frame.used[i])
+                continue;
+
+            GLuint available = GL_FALSE;
+            get_query_objectuiv(frame.queries[i], GL_QUERY_RESULT_AVAILABLE_EXT, &available);
+            if(!available)
+                return;
+            break;
+        }
+
+        std::array<GLuint64, num_passes> results {};
+        for(std::size_t i = 0; i < num_passes; ++i)
+        {
+            if(frame.used[i])
+                get_query_objectui64v(frame.queries[i], GL_QUERY_RESULT_EXT, &results[i]);
+        }
+
+        // a disjoint event (frequency change, context switch, etc) makes any results read since the last check meaningless
+        GLint disjoint = 0;
+        glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+
+        // some drivers return garbage (like a raw timestamp) for the first queries after context creation
+        constexpr GLuint64 max_plausible_ns = 1000000000;
+        if(disjoint || std::any_of(std::begin(results), std::end(results), [](GLuint64 ns) { return ns > max_plausible_ns; }))
+        {
+            ++stats.frames_disjoint;
+        }
+        else
+        {
+            for(std::size_t i = 0; i < num_passes; ++i)
+            {
+                if(frame.used[i])
+                    stats.passes[i].add(results[i]);
+            }
+            ++stats.frames_timed;
+        }
+
+        frame.pending = false;
+        read_frame = (read_frame + 1) % ring_size;
+    }
+}
+
+void Gpu_timer::begin_frame()
+{
+    if(!is_supported())
+        return;
+
+    collect();
+
+    auto & frame = frames[write_frame];
+    recording = !frame.pending;
+    if(recording)
+        frame.used.fill(false);
+    else
+        ++stats.frames_skipped;
+}
+
+void Gpu_timer::end_frame()
+{
+    if(!recording)
+        return;
+
+    frames[write_frame].pending = true;
+    write_frame = (write_frame + 1) % ring_size;
+    recording = false;
+}
+
+void Gpu_timer::begin(Pass pass)
+{
+    if(!recording)
+        return;
+
+    auto & frame = frames[write_frame];
+    auto i = static_cast<std::size_t>(pass);
+    frame.used[i] = true;
+    begin_query(GL_TIME_ELAPSED_EXT, frame.queries[i]);
+}
+
+void Gpu_timer::end(Pass pass)
+{
+    if(!recording || !frames[write_frame].used[static_cast<std::size_t>(pass)])
+        return;
+
+    end_query(GL_TIME_ELAPSED_EXT);
+}
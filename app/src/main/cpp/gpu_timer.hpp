@@ -0,0 +1,98 @@
+// Copyright 2022 Matthew Chandler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef INC_2050_GPU_TIMER_HPP
+#define INC_2050_GPU_TIMER_HPP
+
+#include <array>
+
+#include <GLES3/gl3.h>
+
+#include "histogram.hpp"
+
+// times render passes on the GPU with EXT_disjoint_timer_query. Results are read back a few frames later,
+// and only once they're available, so timing never stalls the pipeline. Everything is a no-op without the extension
+class Gpu_timer
+{
+public:
+    enum class Pass: std::size_t {CLEAR, BALLS, PRESSURE, LABELS}; // in the order they're drawn
+    constexpr static std::size_t num_passes = 4;
+    constexpr static std::array<const char *, num_passes> pass_names {{"clear", "balls", "pressure", "labels"}};
+
+    struct Stats
+    {
+        std::array<Time_histogram, num_passes> passes;
+        unsigned long frames_timed = 0;
+        unsigned long frames_skipped = 0; // no free queries because results were still pending
+        unsigned long frames_disjoint = 0; // results discarded because the GPU timer was disrupted, or were implausible
+    };
+
+private:
+    using Gen_queries_fun = void (GL_APIENTRYP)(GLsizei n, GLuint * ids);
+    using Delete_queries_fun = void (GL_APIENTRYP)(GLsizei n, const GLuint * ids);
+    using Begin_query_fun = void (GL_APIENTRYP)(GLenum target, GLuint id);
+    using End_query_fun = void (GL_APIENTRYP)(GLenum target);
+    using Get_query_objectuiv_fun = void (GL_APIENTRYP)(GLuint id, GLenum pname, GLuint * params);
+    using Get_query_objectui64v_fun = void (GL_APIENTRYP)(GLuint id, GLenum pname, GLuint64 * params);
+
+    Gen_queries_fun gen_queries = nullptr;
+    Delete_queries_fun delete_queries = nullptr;
+    Begin_query_fun begin_query = nullptr;
+    End_query_fun end_query = nullptr;
+    Get_query_objectuiv_fun get_query_objectuiv = nullptr;
+    Get_query_objectui64v_fun get_query_objectui64v = nullptr;
+
+    // frames in flight. Results are usually ready 1-2 frames later
+    constexpr static std::size_t ring_size = 4;
+    struct Frame
+    {
+        std::array<GLuint, num_passes> queries {};
+        std::array<bool, num_passes> used {};
+        bool pending = false;
+    };
+    std::array<Frame, ring_size> frames;
+    std::size_t write_frame = 0;
+    std::size_t read_frame = 0; // oldest pending frame
+    bool recording = false; // current frame has a slot in the ring
+
+    Stats stats;
+
+    void collect();
+
+public:
+    Gpu_timer(); // context must be current
+    ~Gpu_timer();
+    Gpu_timer(const Gpu_timer &) = delete;
+    Gpu_timer & operator=(const Gpu_timer &) = delete;
+
+    bool is_supported() const { return gen_queries != nullptr; }
+
+    // collects any finished results from earlier frames
+    void begin_frame();
+    void end_frame();
+
+    // passes can't overlap
+    void begin(Pass pass);
+    void end(Pass pass);
+
+    const Stats & get_stats() const { return stats; }
+};
+
+#endif //INC_2050_GPU_TIMER_HPP
@@ -0,0 +1,178 @@
+// Copyright 2022 Matthew Chandler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "gravity.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#include <time.h>
+
+#include "log.hpp"
+
+std::int64_t sensor_clock_now()
+{
+    timespec now;
+    clock_gettime(CLOCK_BOOTTIME, &now);
+    return static_cast<std::int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+Trace_source::Trace_source(const std::string & path, std::function<std::int64_t()> clock): clock(std::move(clock))
+{
+    std::ifstream trace_file(path);
+    std::string line;
+    while(std::getline(trace_file, line))
+    {
+        if(std::empty(line) || line[0] == '#')
+            continue;
+
+        std::istringstream line_str(line);
+        Gravity_sample sample;
+        float z;
+        if(line_str >> sample.timestamp >> sample.vec.x >> sample.vec.y >> z)
+        {
+            sample.vec.y = -sample.vec.y;
+            trace.push_back(sample);
+        }
+        else
+        {
+            LOG_ERROR_PRINT("Trace_source::Trace_source", "Malformed line in gravity trace: %s", line.c_str());
+        }
+    }
+
+    LOG_DEBUG_PRINT("Trace_source::Trace_source", "loaded %d samples from %s", static_cast<int>(std::size(trace)), path.c_str());
+}
+
+void Trace_source::enable()
+{
+    if(enabled || empty())
+        return;
+
+    // resume playback where we left off
+    auto next_timestamp = trace[std::min(next_sample, std::size(trace) - 1)].timestamp;
+    time_offset = clock() - next_timestamp;
+    enabled = true;
+}
+void Trace_source::disable() { enabled = false; }
+
+void Trace_source::restart()
+{
+    next_sample = 0;
+    if(enabled && !empty())
+        time_offset = clock() - trace.front().timestamp;
+}
+
+void Trace_source::read(std::vector<Gravity_sample> & samples)
+{
+    if(!enabled)
+        return;
+
+    auto now = clock();
+    for(; next_sample < std::size(trace) && trace[next_sample].timestamp + time_offset <= now; ++next_sample)
+        samples.push_back({trace[next_sample].timestamp + time_offset, trace[next_sample].vec});
+}
+
+Gravity_stage::Gravity_stage(std::unique_ptr<Gravity_source> source, Rotation rotation): source(std::move(source)), rotation(rotation)
+{}
+
+glm::vec2 Gravity_stage::rotate(const glm::vec2 & vec) const
+{
+    // reorient gravity to current screen rotation
+    switch(rotation)
+    {
+    case Rotation::ROTATION_0:
+    default:
+        return vec;
+    case Rotation::ROTATION_90:
+        return {vec.y, -vec.x};
+    case Rotation::ROTATION_180:
+        return {-vec.x, -vec.y};
+    case Rotation::ROTATION_270:
+        return {-vec.y, vec.x};
+    }
+}
+
+void Gravity_stage::enable() { source->enable(); }
+void Gravity_stage::disable()
+{
+    source->disable();
+
+    // don't interpolate across the gap
+    oldest_history = 0;
+    num_history = 0;
+}
+
+void Gravity_stage::update()
+{
+    batch.clear();
+    source->read(batch);
+
+    for(auto & sample: batch)
+    {
+        // first order low-pass filter, weighted by actual time between samples
+        auto vec = rotate(sample.vec);
+        if(num_history == 0)
+        {
+            filtered.vec = vec;
+        }
+        else
+        {
+            auto dt = static_cast<float>(sample.timestamp - filtered.timestamp) * 1.0e-9f;
+            auto alpha = std::max(dt, 0.0f) / (filter_time_constant + std::max(dt, 0.0f));
+            filtered.vec += alpha * (vec - filtered.vec);
+        }
+        filtered.timestamp = sample.timestamp;
+
+        if(num_history < max_history)
+        {
+            history[(oldest_history + num_history) % max_history] = filtered;
+            ++num_history;
+        }
+        else
+        {
+            history[oldest_history] = filtered;
+            oldest_history = (oldest_history + 1) % max_history;
+        }
+    }
+}
+
+glm::vec2 Gravity_stage::get(std::int64_t timestamp) const
+{
+    if(num_history == 0)
+        return filtered.vec;
+
+    auto & oldest = get_history(0);
+    auto & newest = get_history(num_history - 1);
+    if(timestamp <= oldest.timestamp)
+        return oldest.vec;
+    if(timestamp >= newest.timestamp)
+        return newest.vec;
+
+    // first sample after timestamp. There are few enough to search in order
+    std::size_t next_i = 1;
+    while(get_history(next_i).timestamp <= timestamp)
+        ++next_i;
+    auto & prev = get_history(next_i - 1);
+    auto & next = get_history(next_i);
+
+    auto t = static_cast<float>(timestamp - prev.timestamp) / static_cast<float>(next.timestamp - prev.timestamp);
+    return glm::mix(prev.vec, next.vec, t);
+}
@@ -0,0 +1,114 @@
+// Copyright 2022 Matthew Chandler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef INC_2050_GRAVITY_HPP
+#define INC_2050_GRAVITY_HPP
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// gravity sampling and filtering, without the Android sensor API, so it can also be driven from tools/headless.
+// The device accelerometer source is in sensor.hpp
+
+// Shadows android.View.Surface.ROTATION_*
+enum class Rotation: int{ROTATION_0, ROTATION_90, ROTATION_180, ROTATION_270};
+
+// current time on the same clock as sensor event timestamps (CLOCK_BOOTTIME), in ns
+std::int64_t sensor_clock_now();
+
+struct Gravity_sample
+{
+    std::int64_t timestamp; // ns
+    glm::vec2 vec;
+};
+
+// a source of raw accelerometer readings, in screen orientation ROTATION_0
+class Gravity_source
+{
+public:
+    virtual ~Gravity_source() = default;
+
+    virtual void enable() = 0;
+    virtual void disable() = 0;
+
+    // append every sample that has arrived since the last call
+    virtual void read(std::vector<Gravity_sample> & samples) = 0;
+};
+
+// plays back a recorded trace, one "timestamp_ns x y z" sample per line, in real time
+class Trace_source final: public Gravity_source
+{
+private:
+    std::vector<Gravity_sample> trace;
+    std::size_t next_sample = 0;
+    std::int64_t time_offset = 0; // maps trace timestamps to clock()
+    bool enabled = false;
+    std::function<std::int64_t()> clock;
+
+public:
+    // clock defaults to the sensor clock. tools/headless passes a simulated one, so replay is deterministic
+    explicit Trace_source(const std::string & path, std::function<std::int64_t()> clock = sensor_clock_now);
+
+    bool empty() const { return std::empty(trace); }
+    bool finished() const { return next_sample >= std::size(trace); }
+    void restart(); // play again from the first sample
+
+    void enable() override;
+    void disable() override;
+    void read(std::vector<Gravity_sample> & samples) override;
+};
+
+// drains a Gravity_source in batches, then filters and rotates each sample once
+// physics can then sample gravity at any time, interpolated between readings
+class Gravity_stage
+{
+private:
+    std::unique_ptr<Gravity_source> source;
+    const Rotation rotation;
+
+    constexpr static float filter_time_constant = 0.03f; // s
+    constexpr static std::size_t max_history = 16;
+
+    std::vector<Gravity_sample> batch; // scratch buffer for raw samples
+    std::array<Gravity_sample, max_history> history; // filtered, rotated samples. Ring buffer, so it never allocates
+    std::size_t oldest_history = 0; // index into history
+    std::size_t num_history = 0;
+    const Gravity_sample & get_history(std::size_t i) const { return history[(oldest_history + i) % max_history]; } // i-th oldest
+    Gravity_sample filtered {0, {0.0f, -1.0f}};
+
+    glm::vec2 rotate(const glm::vec2 & vec) const;
+
+public:
+    Gravity_stage(std::unique_ptr<Gravity_source> source, Rotation rotation);
+
+    void enable();
+    void disable();
+
+    void update();
+    glm::vec2 get(std::int64_t timestamp) const;
+};
+
+#endif //INC_2050_GRAVITY_HPP
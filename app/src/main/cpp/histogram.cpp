@@ -0,0 +1,72 @@
+// Copyright 2022 Matthew Chandler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "histogram.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+void Time_histogram::add(std::uint64_t ns)
+{
+    std::size_t bucket = 0;
+    for(auto edge = ns >> min_shift; edge > 0 && bucket < num_buckets - 1; edge >>= 1)
+        ++bucket;
+
+    ++buckets[bucket];
+    ++count;
+    total_ns += ns;
+    max_ns = std::max(max_ns, ns);
+}
+
+float Time_histogram::total_ms() const
+{
+    return 1.0e-6f * static_cast<float>(total_ns);
+}
+
+float Time_histogram::mean_ms() const
+{
+    return count > 0 ? total_ms() / static_cast<float>(count) : 0.0f;
+}
+
+float Time_histogram::max_ms() const
+{
+    return 1.0e-6f * static_cast<float>(max_ns);
+}
+
+float Time_histogram::percentile_ms(float p) const
+{
+    if(count == 0)
+        return 0.0f;
+
+    auto target = static_cast<unsigned long>(std::ceil(p * static_cast<float>(count)));
+    unsigned long seen = 0;
+    for(std::size_t i = 0; i < num_buckets; ++i)
+    {
+        seen += buckets[i];
+        if(seen >= target)
+        {
+            // the last bucket has no upper edge, so the largest value in it is the only bound there is
+            if(i == num_buckets - 1)
+                return max_ms();
+            return std::min(1.0e-6f * static_cast<float>(std::uint64_t{1} << (min_shift + i)), max_ms());
+        }
+    }
+    return max_ms();
+}
@@ -0,0 +1,53 @@
+// Copyright 2022 Matthew Chandler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef INC_2050_HISTOGRAM_HPP
+#define INC_2050_HISTOGRAM_HPP
+
+#include <array>
+#include <cstdint>
+
+// durations, in power of 2 buckets. Cheap enough to update on every frame or lock
+class Time_histogram
+{
+public:
+    constexpr static std::size_t num_buckets = 18;
+    // first bucket is anything under 2^10 ns (~1 us). Each one after ends at twice the last, except the last, which is
+    // everything from 2^26 ns (~67 ms) up, and has no upper edge
+    constexpr static unsigned int min_shift = 10;
+
+private:
+    std::array<unsigned long, num_buckets> buckets {};
+    unsigned long count = 0;
+    std::uint64_t total_ns = 0;
+    std::uint64_t max_ns = 0;
+
+public:
+    void add(std::uint64_t ns);
+
+    unsigned long get_count() const { return count; }
+    const std::array<unsigned long, num_buckets> & get_buckets() const { return buckets; }
+    float total_ms() const;
+    float mean_ms() const;
+    float max_ms() const;
+    float percentile_ms(float p) const; // upper edge of the bucket containing the p-th percentile. max_ms in the last bucket
+};
+
+#endif //INC_2050_HISTOGRAM_HPP
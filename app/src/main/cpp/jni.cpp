@@ -18,6 +18,7 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 // SOFTWARE.
 
+#include <algorithm>
 #include <memory>
 
 #include <android/asset_manager_jni.h>
@@ -27,17 +28,13 @@
 
 #include "color.hpp"
 #include "engine.hpp"
+#include "event_dispatcher.hpp"
 #include "log.hpp"
+#include "trace.hpp"
 
 
 std::unique_ptr<Engine> engine;
 
-#define DISP_DATA_FIELDS \
-X(ObservableInt, set_int, score) \
-X(ObservableInt, set_int, high_score)\
-X(ObservableFloat, set_float, grav_angle)\
-X(ObservableInt, set_int, pressure)
-
 struct JVM_refs
 {
     void init(JNIEnv * env, jobject activity, jobject resources_local) noexcept
@@ -102,34 +99,6 @@ struct JVM_refs
         get_color_method = env->GetStaticMethodID(context_compat_local, "getColor", "(Landroid/content/Context;I)I");
         if(!get_color_method)
             __android_log_assert("Couldn't get 'ContextCompat.getColor' method", "JNI", nullptr);
-
-        // get DispData class fields, and set methods for each
-        jclass observable_int = env->FindClass("androidx/databinding/ObservableInt");
-        if(!observable_int)
-            __android_log_assert("Couldn't get 'ObservableInt' class", "JNI", nullptr);
-
-        set_int = env->GetMethodID(observable_int, "set", "(I)V");
-        if(!set_int)
-            __android_log_assert("Couldn't get 'ObservableInt.set' method", "JNI", nullptr);
-
-        jclass observable_float = env->FindClass("androidx/databinding/ObservableFloat");
-        if(!observable_float)
-            __android_log_assert("Couldn't get 'ObservableFloat' class", "JNI", nullptr);
-
-        set_float = env->GetMethodID(observable_float, "set", "(F)V");
-        if(!set_float)
-            __android_log_assert("Couldn't get 'ObservableFloat.set' method", "JNI", nullptr);
-
-        jclass DispData = env->FindClass("org/mattvchandler/a2050/MainActivity$DispData");
-        if(!DispData)
-            __android_log_assert("Couldn't get 'DispData' class", "JNI", nullptr);
-
-#define X(type, method, name) \
-            name = env->GetFieldID(DispData, #name, "Landroidx/databinding/" #type ";");\
-            if(!name)\
-                __android_log_assert("Couldn't get '" #name "' field", "JNI", nullptr);
-        DISP_DATA_FIELDS
-#undef X
     }
 
     void destroy(JNIEnv * env) noexcept
@@ -151,11 +120,6 @@ struct JVM_refs
         context_compat       = nullptr;
         get_int_array_method = nullptr;
         get_color_method     = nullptr;
-        set_int              = nullptr;
-        set_float            = nullptr;
-#define X(type, method, name) name = nullptr;
-        DISP_DATA_FIELDS
-#undef X
     }
 
     JavaVM * vm                    = nullptr;
@@ -171,13 +135,6 @@ struct JVM_refs
     jclass    context_compat       = nullptr;
     jmethodID get_int_array_method = nullptr;
     jmethodID get_color_method     = nullptr;
-
-    jmethodID set_int              = nullptr;
-    jmethodID set_float            = nullptr;
-
-#define X(type, method, name) jfieldID name = nullptr;
-    DISP_DATA_FIELDS
-#undef X
 };
 
 JVM_refs jvm_refs;
@@ -211,23 +168,56 @@ public:
     JNIEnv *operator->() { return env; }
 };
 
-void game_win(int score, bool new_high_score)
+// calls into MainActivity, queued by the physics thread. They're made from a single thread that stays attached to the JVM,
+// so physics never waits on attaching, or on whatever the Kotlin side does
+struct JNI_sender
 {
     Java_thread_env env;
 
-    env->CallVoidMethod(jvm_refs.main_activity, jvm_refs.game_win_method, score, new_high_score);
+    void operator()(const Game_event & event)
+    {
+        switch(event.type)
+        {
+        case Game_event::Type::GAME_WIN:
+        {
+            TRACE_SCOPE("JNI game_win");
+            env->CallVoidMethod(jvm_refs.main_activity, jvm_refs.game_win_method, event.value, event.new_high_score);
+            break;
+        }
+        case Game_event::Type::GAME_OVER:
+        {
+            TRACE_SCOPE("JNI game_over");
+            env->CallVoidMethod(jvm_refs.main_activity, jvm_refs.game_over_method, event.value, event.new_high_score);
+            break;
+        }
+        case Game_event::Type::ACHIEVEMENT:
+        {
+            TRACE_SCOPE("JNI achievement");
+            env->CallVoidMethod(jvm_refs.main_activity, jvm_refs.achievement_method, event.value);
+            break;
+        }
+        }
+    }
+};
+
+// started after jvm_refs is initialized, and stopped before it's destroyed
+Event_dispatcher<JNI_sender> event_dispatcher;
+
+void game_win(int score, bool new_high_score)
+{
+    event_dispatcher.post(Game_event::Type::GAME_WIN, score, new_high_score);
 }
 void game_over(int score, bool new_high_score)
 {
-    Java_thread_env env;
-
-    env->CallVoidMethod(jvm_refs.main_activity, jvm_refs.game_over_method, score, new_high_score);
+    event_dispatcher.post(Game_event::Type::GAME_OVER, score, new_high_score);
 }
 void achievement(int size)
 {
-    Java_thread_env env;
-
-    env->CallVoidMethod(jvm_refs.main_activity, jvm_refs.achievement_method, size);
+    event_dispatcher.post(Game_event::Type::ACHIEVEMENT, size);
+}
+unsigned long get_posted_event_count()
+{
+    return event_dispatcher.get_posted();
 }
 
 std::vector<int> get_res_int_array(const std::string & id)
@@ -273,16 +263,19 @@ bool first_run = true;
 
 extern "C"
 {
-JNIEXPORT void JNICALL Java_org_mattvchandler_a2050_MainActivity_create(JNIEnv * env, jobject activity, jobject assetManager, jstring path, jobject resources_local, jboolean gravity_mode, jint rotation)
+JNIEXPORT void JNICALL Java_org_mattvchandler_a2050_MainActivity_create(JNIEnv * env, jobject activity, jobject assetManager, jstring path, jobject resources_local, jboolean gravity_mode, jint rotation,
+                                                                      jboolean pressure_overlay, jboolean sandbox, jfloat sandbox_arena_size, jfloat sandbox_spawn_rate, jint sandbox_max_balls)
 {
     if(engine)
         __android_log_assert("create called after engine initialized", "JNI", nullptr);
 
     jvm_refs.init(env, activity, resources_local);
+    event_dispatcher.start();
 
     const char * data_path = env->GetStringUTFChars(path, nullptr);
 
-    engine = std::make_unique<Engine>(AAssetManager_fromJava(env, assetManager), data_path, first_run, gravity_mode, static_cast<Rotation>(rotation));
+    Sandbox_config sandbox_config{static_cast<bool>(sandbox), sandbox_arena_size, sandbox_spawn_rate, static_cast<std::size_t>(std::max(sandbox_max_balls, 1))};
+    engine = std::make_unique<Engine>(AAssetManager_fromJava(env, assetManager), data_path, first_run, gravity_mode, static_cast<Rotation>(rotation), static_cast<bool>(pressure_overlay), sandbox_config);
 
     first_run = false;
 
@@ -316,6 +309,7 @@ JNIEXPORT void JNICALL Java_org_mattvchandler_a2050_MainActivity_destroy(JNIEnv
         __android_log_assert("destroy called before engine initialized", "JNI", nullptr);
     engine.reset();
 
+    event_dispatcher.stop();
     jvm_refs.destroy(env);
 }
 
@@ -354,17 +348,12 @@ JNIEXPORT void JNICALL Java_org_mattvchandler_a2050_MainActivity_pauseGame(JNIEn
         __android_log_assert("pauseGame called before engine initialized", "JNI", nullptr);
     engine->pause_game();
 }
-JNIEXPORT void JNICALL Java_org_mattvchandler_a2050_MainActivity_getUIData(JNIEnv * env, jobject, jobject dispdata)
+JNIEXPORT jobject JNICALL Java_org_mattvchandler_a2050_MainActivity_getUIDataBuffer(JNIEnv * env, jobject)
 {
     if(!engine)
-        __android_log_assert("getUIData called before engine initialized", "JNI", nullptr);
-
-    auto data = engine->get_ui_data();
-#define X(type, method, name) \
-        jobject name = env->GetObjectField(dispdata, jvm_refs.name);\
-        env->CallVoidMethod(name, jvm_refs.method, data.name);
-    DISP_DATA_FIELDS
-#undef X
+        __android_log_assert("getUIDataBuffer called before engine initialized", "JNI", nullptr);
+
+    return env->NewDirectByteBuffer(engine->get_ui_data_buffer(), static_cast<jlong>(Engine::get_ui_data_buffer_size()));
 }
 
 JNIEXPORT jint JNICALL Java_org_mattvchandler_a2050_MainActivity_calcTextColor(JNIEnv *, jclass, jint color)
@@ -26,9 +26,11 @@
 
 #include <jni.h>
 
+// these only queue the call. It's made later from a dedicated thread, so they're safe to call with the engine mutex held
 void game_over(int score, bool new_high_score);
 void game_win(int score, bool new_high_score);
 void achievement(int size);
+unsigned long get_posted_event_count(); // total calls queued so far
 int get_res_color(const std::string & id);
 std::vector<int> get_res_int_array(const std::string & id);
 
@@ -0,0 +1,191 @@
+// Copyright 2022 Matthew Chandler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "label_batch.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <string>
+
+#include "log.hpp"
+
+Label_batch::Label_batch(const unsigned char * atlas_data, std::size_t atlas_data_size,
+                         const std::string_view & vert_src, const std::string_view & frag_src, bool use_fences, Program_cache * cache):
+    prog{std::vector<std::pair<std::string_view, GLenum>>{{vert_src, GL_VERTEX_SHADER}, {frag_src, GL_FRAGMENT_SHADER}},
+         std::vector<std::string>{"center", "offset", "tex_coord", "color"}, cache},
+    screen_size_uniform{prog.get_uniform<glm::vec2>("screen_size")},
+    scale_uniform{prog.get_uniform<GLfloat>("scale")},
+    rotation_uniform{prog.get_uniform<glm::vec2>("rotation")},
+    smoothing_uniform{prog.get_uniform<GLfloat>("smoothing")},
+    stream{GL_ARRAY_BUFFER, 64 * 2 * verts_per_quad * Label_vertex::stride, use_fences}
+{
+    if(atlas_data_size < sizeof(header))
+        __android_log_assert("Glyph atlas too small", "Label_batch::Label_batch", nullptr);
+
+    std::memcpy(&header, atlas_data, sizeof(header));
+    if(std::memcmp(header.magic, sdf_atlas::magic, sizeof(header.magic)) != 0)
+        __android_log_assert("Glyph atlas has bad magic", "Label_batch::Label_batch", nullptr);
+    if(atlas_data_size < sizeof(header) + header.width * header.height)
+        __android_log_assert("Glyph atlas truncated", "Label_batch::Label_batch", nullptr);
+
+    LOG_DEBUG_PRINT("Label_batch::Label_batch", "loaded %u x %u glyph atlas", header.width, header.height);
+
+    prog.use();
+    glUniform1i(prog.get_uniform("atlas"), 0);
+
+    atlas.bind();
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, static_cast<GLsizei>(header.width), static_cast<GLsizei>(header.height), 0,
+                 GL_ALPHA, GL_UNSIGNED_BYTE, atlas_data + sizeof(header));
+
+    get_run(prebuilt_runs - 1);
+
+    GL_CHECK_ERROR("Label_batch::Label_batch");
+}
+
+void Label_batch::resize(unsigned int pixel_size)
+{
+    scale = static_cast<float>(pixel_size) / header.em_size;
+}
+
+// quads for a ball's label (2^size), centered on the text's bounding box
+const Label_batch::Run & Label_batch::get_run(int size)
+{
+    while(size >= static_cast<int>(std::size(runs)))
+    {
+        auto text = std::to_string(1u << std::size(runs));
+
+        Run run;
+        glm::vec2 bbox_min{0.0f}, bbox_max{0.0f};
+        float pen = 0.0f;
+        for(auto c: text)
+        {
+            auto & glyph = header.glyphs[static_cast<std::size_t>(c - '0')];
+            Quad quad;
+            quad.min = glm::vec2{pen + glyph.bearing[0], glyph.bearing[1]};
+            quad.max = quad.min + glm::vec2{glyph.size[0], glyph.size[1]};
+            quad.uv_min = {glyph.uv_min[0], glyph.uv_min[1]};
+            quad.uv_max = {glyph.uv_max[0], glyph.uv_max[1]};
+
+            if(std::empty(run))
+            {
+                bbox_min = quad.min;
+                bbox_max = quad.max;
+            }
+            else
+            {
+                bbox_min = glm::min(bbox_min, quad.min);
+                bbox_max = glm::max(bbox_max, quad.max);
+            }
+
+            run.push_back(quad);
+            pen += glyph.advance;
+        }
+
+        auto center = 0.5f * (bbox_min + bbox_max);
+        for(auto & quad: run)
+        {
+            quad.min -= center;
+            quad.max -= center;
+        }
+
+        runs.push_back(std::move(run));
+    }
+
+    return runs[static_cast<std::size_t>(size)];
+}
+
+void Label_batch::add(int size, const glm::vec2 & center, const glm::vec4 & color)
+{
+    // sizes come from save files unchecked. Clamp as World::pack_size does, so get_run never shifts by 32 or more
+    size = std::clamp(size, 0, prebuilt_runs - 1);
+    auto c = glm::clamp(color, 0.0f, 1.0f) * 255.0f;
+    labels.push_back({size, center, {static_cast<GLubyte>(std::lround(c.r)), static_cast<GLubyte>(std::lround(c.g)),
+                                     static_cast<GLubyte>(std::lround(c.b)), static_cast<GLubyte>(std::lround(c.a))}});
+}
+
+std::size_t Label_batch::draw(const glm::vec2 & screen_size, float angle)
+{
+    std::size_t num_verts = 0;
+    for(auto & label: labels)
+        num_verts += std::size(get_run(label.size)) * verts_per_quad;
+
+    if(num_verts == 0)
+    {
+        labels.clear();
+        return 0;
+    }
+
+    auto data_size = num_verts * Label_vertex::stride;
+    if(std::size(vertex_data) < data_size)
+        vertex_data.resize(data_size);
+
+    auto pack_uv = [](const glm::vec2 & uv) -> std::array<GLushort, 2>
+    {
+        return {static_cast<GLushort>(std::lround(uv.x * 65535.0f)), static_cast<GLushort>(std::lround(uv.y * 65535.0f))};
+    };
+
+    std::size_t data_i = 0;
+    for(auto & label: labels)
+    {
+        for(auto & quad: get_run(label.size))
+        {
+            const std::array<std::pair<glm::vec2, glm::vec2>, 4> corners
+            {{
+                {{quad.min.x, quad.min.y}, {quad.uv_min.x, quad.uv_min.y}},
+                {{quad.max.x, quad.min.y}, {quad.uv_max.x, quad.uv_min.y}},
+                {{quad.max.x, quad.max.y}, {quad.uv_max.x, quad.uv_max.y}},
+                {{quad.min.x, quad.max.y}, {quad.uv_min.x, quad.uv_max.y}}
+            }};
+
+            for(auto i: {0, 1, 2, 0, 2, 3})
+            {
+                Label_vertex::pack(&vertex_data[data_i], {label.center.x, label.center.y}, {corners[i].first.x, corners[i].first.y},
+                                   pack_uv(corners[i].second), label.color);
+                data_i += Label_vertex::stride;
+            }
+        }
+    }
+    labels.clear();
+
+    prog.use();
+    screen_size_uniform.set(screen_size);
+    scale_uniform.set(scale);
+    // labels are only ever rotated by multiples of pi/2, so round off the float error to keep glyphs pixel-aligned
+    rotation_uniform.set({std::round(std::cos(angle)), std::round(std::sin(angle))});
+    // half a screen pixel, in distance field units
+    smoothing_uniform.set(0.25f / (header.spread * scale));
+
+    glActiveTexture(GL_TEXTURE0);
+    atlas.bind();
+
+    auto offset = stream.upload(std::data(vertex_data), data_size);
+    Label_vertex::enable(0, offset);
+    glDrawArrays(GL_TRIANGLES, 0, static_cast<GLsizei>(num_verts));
+    Label_vertex::disable();
+    stream.fence();
+
+    return data_size;
+}
@@ -0,0 +1,91 @@
+// Copyright 2022 Matthew Chandler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef INC_2050_LABEL_BATCH_HPP
+#define INC_2050_LABEL_BATCH_HPP
+
+#include <array>
+#include <string_view>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "opengl.hpp"
+#include "sdf_atlas.hpp"
+
+// draws every ball's label in a single draw call. Glyphs come from a signed distance field atlas generated at build time
+// (see tools/sdf_atlas), so changing the text size or rotation is just a uniform change
+class Label_batch
+{
+private:
+    struct Quad
+    {
+        glm::vec2 min{0.0f}, max{0.0f}; // relative to the label's center, in atlas pixels
+        glm::vec2 uv_min{0.0f}, uv_max{0.0f};
+    };
+    using Run = std::vector<Quad>;
+    constexpr static int prebuilt_runs = 32; // sizes up to 2^31, so drawing doesn't allocate for any ball a game can make
+
+    struct Label
+    {
+        int size;
+        glm::vec2 center;
+        std::array<GLubyte, 4> color;
+    };
+
+    using Label_vertex = Vertex_layout<Vertex_attrib<GLfloat, 2>, Vertex_attrib<GLfloat, 2>, Vertex_attrib<GLushort, 2, GL_TRUE>, Vertex_attrib<GLubyte, 4, GL_TRUE>>; // center, offset, tex_coord, color
+    constexpr static std::size_t verts_per_quad = 6;
+
+    sdf_atlas::Header header;
+    float scale = 1.0f; // screen pixels per atlas pixel
+
+    std::vector<Run> runs; // indexed by ball size
+    std::vector<Label> labels; // queued for the next draw
+    std::vector<std::uint8_t> vertex_data;
+
+    Shader_prog prog;
+    Uniform<glm::vec2> screen_size_uniform;
+    Uniform<GLfloat> scale_uniform;
+    Uniform<glm::vec2> rotation_uniform;
+    Uniform<GLfloat> smoothing_uniform;
+    GL_texture atlas;
+    Streaming_buffer stream;
+
+    const Run & get_run(int size);
+
+public:
+    Label_batch(const unsigned char * atlas_data, std::size_t atlas_data_size,
+                const std::string_view & vert_src, const std::string_view & frag_src, bool use_fences, Program_cache * cache = nullptr);
+    Label_batch(const Label_batch &) = delete;
+    Label_batch & operator=(const Label_batch &) = delete;
+
+    // set the text size, in pixels
+    void resize(unsigned int pixel_size);
+
+    // queue the label for a ball of the given size, centered on center (in pixels, origin at top left)
+    void add(int size, const glm::vec2 & center, const glm::vec4 & color);
+
+    // draw all queued labels, rotated by angle about their centers, and clear the queue. Returns bytes uploaded
+    std::size_t draw(const glm::vec2 & screen_size, float angle);
+
+    const Streaming_buffer::Stats & get_stream_stats() const { return stream.get_stats(); }
+};
+
+#endif //INC_2050_LABEL_BATCH_HPP
@@ -27,15 +27,19 @@
 
 #include <android/log.h>
 
+#include "log_ring.hpp"
+
+// formatting and writing happen later, on log_ring's thread, except for errors. See log_ring.hpp
+#define LOG_RING_PRINT(PRIO, TAG, FMT, ...) do { if(false) log_ring::check_format(FMT, __VA_ARGS__); log_ring::print(PRIO, TAG, FMT, __VA_ARGS__); } while(false)
+
 #ifdef NDEBUG
 #define LOG_DEBUG_WRITE(TAG, TXT)
 #define LOG_DEBUG_PRINT(TAG, FMT, ...)
 #else
-#define LOG_DEBUG_WRITE(TAG, TXT) do {__android_log_write(ANDROID_LOG_DEBUG, TAG, TXT); } while(false)
-#define LOG_DEBUG_PRINT(TAG, FMT, ...) do {__android_log_print(ANDROID_LOG_DEBUG, TAG, FMT, __VA_ARGS__); } while(false)
+#define LOG_DEBUG_WRITE(TAG, TXT) LOG_RING_PRINT(ANDROID_LOG_DEBUG, TAG, "%s", TXT)
+#define LOG_DEBUG_PRINT(TAG, FMT, ...) LOG_RING_PRINT(ANDROID_LOG_DEBUG, TAG, FMT, __VA_ARGS__)
 #endif
 
-#define LOG_ERROR_WRITE(TAG, TXT) do {__android_log_write(ANDROID_LOG_ERROR, TAG, TXT); } while(false)
-#define LOG_ERROR_PRINT(TAG, FMT, ...) do {__android_log_print(ANDROID_LOG_ERROR, TAG, FMT, __VA_ARGS__); } while(false)
-
+#define LOG_ERROR_WRITE(TAG, TXT) LOG_RING_PRINT(ANDROID_LOG_ERROR, TAG, "%s", TXT)
+#define LOG_ERROR_PRINT(TAG, FMT, ...) LOG_RING_PRINT(ANDROID_LOG_ERROR, TAG, FMT, __VA_ARGS__)
 #endif //INC_2050_LOG_HPP
@@ -0,0 +1,496 @@
+// Copyright 2022 Matthew Chandler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "log_ring.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <android/log.h>
+
+#include "trace.hpp"
+
+namespace log_ring
+{
+    namespace
+    {
+        using detail::Arg;
+        using detail::Arg_kind;
+        using detail::Record_header;
+
+        // written only by the thread that owns it, read only by whoever holds the flusher's mutex
+        struct Thread_ring
+        {
+            constexpr static std::size_t capacity = 1 << 16;
+            static_assert(capacity >= 2 * detail::max_record_size);
+
+            alignas(8) std::array<unsigned char, capacity> data;
+            std::atomic<std::size_t> head {0}; // byte offsets, never wrapped
+            std::atomic<std::size_t> tail {0};
+            std::size_t reserved_head = 0;
+
+            std::atomic<unsigned long> dropped {0};
+            unsigned long dropped_reported = 0;
+
+            // rings are kept when their thread exits, for the next new thread to pick up
+            std::atomic<bool> in_use {true};
+        };
+
+        const char * priority_str(int prio)
+        {
+            switch(prio)
+            {
+            case ANDROID_LOG_VERBOSE: return "V";
+            case ANDROID_LOG_DEBUG:   return "D";
+            case ANDROID_LOG_INFO:    return "I";
+            case ANDROID_LOG_WARN:    return "W";
+            case ANDROID_LOG_ERROR:   return "E";
+            case ANDROID_LOG_FATAL:   return "F";
+            default:                  return "?";
+            }
+        }
+
+        // appends to a fixed buffer, truncating once it's full
+        class Line
+        {
+        private:
+            std::array<char, detail::max_record_size> buffer;
+            std::size_t used = 0;
+
+        public:
+            Line() { buffer[0] = '\0'; }
+            const char * c_str() const { return std::data(buffer); }
+
+            void append(const char * text, std::size_t length)
+            {
+                length = std::min(length, std::size(buffer) - 1 - used);
+                std::memcpy(std::data(buffer) + used, text, length);
+                used += length;
+                buffer[used] = '\0';
+            }
+
+            template<typename T>
+            void append_formatted(const char * spec, T value)
+            {
+                auto remaining = std::size(buffer) - used;
+                auto written = std::snprintf(std::data(buffer) + used, remaining, spec, value);
+                if(written > 0)
+                    used += std::min(static_cast<std::size_t>(written), remaining - 1);
+            }
+        };
+
+        // the argument's type is recovered from the conversion's length modifier, as va_arg would
+        void format_int(Line & line, const char * spec, const char * length, char conversion, const Arg & arg)
+        {
+            auto is_signed = conversion == 'd' || conversion == 'i';
+            auto value = arg.value;
+            if(std::strcmp(length, "l") == 0)
+            {
+                if(is_signed) line.append_formatted(spec, static_cast<long>(value));
+                else          line.append_formatted(spec, static_cast<unsigned long>(value));
+            }
+            else if(std::strcmp(length, "ll") == 0)
+            {
+                if(is_signed) line.append_formatted(spec, static_cast<long long>(value));
+                else          line.append_formatted(spec, static_cast<unsigned long long>(value));
+            }
+            else if(std::strcmp(length, "j") == 0)
+            {
+                if(is_signed) line.append_formatted(spec, static_cast<std::intmax_t>(value));
+                else          line.append_formatted(spec, static_cast<std::uintmax_t>(value));
+            }
+            else if(std::strcmp(length, "z") == 0 || std::strcmp(length, "t") == 0)
+            {
+                if(is_signed) line.append_formatted(spec, static_cast<std::ptrdiff_t>(value));
+                else          line.append_formatted(spec, static_cast<std::size_t>(value));
+            }
+            else // none, h, hh, and %c all take a promoted int
+            {
+                if(is_signed) line.append_formatted(spec, static_cast<int>(value));
+                else          line.append_formatted(spec, static_cast<unsigned int>(value));
+            }
+        }
+
+        void format_record(Line & line, const Record_header & header, const Arg * args, const char * strings)
+        {
+            std::size_t next_arg = 0;
+            auto take_arg = [&]() -> const Arg * { return next_arg < header.num_args ? &args[next_arg++] : nullptr; };
+            auto take_string = [&](const Arg & arg)
+            {
+                auto str = strings;
+                strings += arg.value + 1;
+                return str;
+            };
+
+            for(auto c = header.fmt; *c;)
+            {
+                if(*c != '%')
+                {
+                    auto end = std::strchr(c, '%');
+                    auto length = end ? static_cast<std::size_t>(end - c) : std::strlen(c);
+                    line.append(c, length);
+                    c += length;
+                    continue;
+                }
+                if(c[1] == '%')
+                {
+                    line.append("%", 1);
+                    c += 2;
+                    continue;
+                }
+
+                // rebuild the conversion spec, with any * width or precision filled in
+                std::array<char, 32> spec;
+                std::size_t spec_len = 0;
+                auto push = [&spec, &spec_len](char ch) { if(spec_len < std::size(spec) - 1) spec[spec_len++] = ch; };
+                auto push_star = [&]()
+                {
+                    auto arg = take_arg();
+                    std::array<char, 16> star;
+                    std::snprintf(std::data(star), std::size(star), "%d", arg ? static_cast<int>(arg->value) : 0);
+                    for(auto ch = std::data(star); *ch; ++ch)
+                        push(*ch);
+                };
+
+                push(*c++);
+                while(*c && std::strchr("-+ #0", *c))
+                    push(*c++);
+
+                if(*c == '*') { push_star(); ++c; }
+                while(*c >= '0' && *c <= '9')
+                    push(*c++);
+
+                if(*c == '.')
+                {
+                    push(*c++);
+                    if(*c == '*') { push_star(); ++c; }
+                    while(*c >= '0' && *c <= '9')
+                        push(*c++);
+                }
+
+                std::array<char, 3> length {};
+                std::size_t length_len = 0;
+                while(*c && std::strchr("hljztL", *c))
+                {
+                    if(length_len < std::size(length) - 1)
+                        length[length_len++] = *c;
+                    ++c;
+                }
+
+                auto conversion = *c;
+                if(!conversion)
+                    break;
+                ++c;
+
+                auto arg = take_arg();
+                if(!arg)
+                {
+                    line.append("<missing>", 9);
+                    continue;
+                }
+
+                // long double is passed on as double, so L is left off
+                auto is_float = std::strchr("fFeEgGaA", conversion) != nullptr;
+                if(!is_float || std::strcmp(std::data(length), "L") != 0)
+                    for(std::size_t i = 0; i < length_len; ++i)
+                        push(length[i]);
+                push(conversion);
+                spec[spec_len] = '\0';
+
+                if(std::strchr("diouxXc", conversion) && (arg->kind == Arg_kind::INT || arg->kind == Arg_kind::UINT))
+                    format_int(line, std::data(spec), std::data(length), conversion, *arg);
+                else if(is_float && arg->kind == Arg_kind::DOUBLE)
+                {
+                    double d;
+                    std::memcpy(&d, &arg->value, sizeof(d));
+                    line.append_formatted(std::data(spec), d);
+                }
+                else if(conversion == 's' && arg->kind == Arg_kind::STRING)
+                    line.append_formatted(std::data(spec), take_string(*arg));
+                else if(conversion == 'p' && arg->kind == Arg_kind::POINTER)
+                    line.append_formatted(std::data(spec), reinterpret_cast<const void *>(static_cast<std::uintptr_t>(arg->value)));
+                else
+                {
+                    // check_format should catch these at compile time. Keep the string offsets in step anyway
+                    if(arg->kind == Arg_kind::STRING)
+                        take_string(*arg);
+                    line.append("<?>", 3);
+                }
+            }
+        }
+
+        class Flusher
+        {
+        private:
+            std::mutex mutex; // guards everything below, and the consumer side of every ring
+            std::vector<std::unique_ptr<Thread_ring>> rings;
+            std::FILE * file = nullptr;
+
+            // wake_mutex is only taken by a producer when pending goes from false to true, so at most once per drain
+            std::mutex wake_mutex;
+            std::condition_variable wake_cv;
+            std::atomic<bool> pending {false};
+
+            // set at exit, after which each message is written as soon as it's logged
+            std::atomic<bool> synchronous {false};
+
+            void write(int prio, const char * tag, const char * text)
+            {
+                if(file)
+                    std::fprintf(file, "%s/%s: %s\n", priority_str(prio), tag, text);
+                else
+                    __android_log_write(prio, tag, text);
+            }
+
+            void drain(Thread_ring & ring)
+            {
+                auto tail = ring.tail.load(std::memory_order_relaxed);
+                auto head = ring.head.load(std::memory_order_acquire);
+                while(tail != head)
+                {
+                    auto offset = tail % Thread_ring::capacity;
+                    auto record = std::data(ring.data) + offset;
+
+                    // padding at the very end of the ring may be shorter than a full header
+                    Record_header header {};
+                    std::memcpy(&header, record, std::min(sizeof(header), Thread_ring::capacity - offset));
+
+                    if(header.prio != ANDROID_LOG_UNKNOWN)
+                    {
+                        std::array<Arg, detail::max_args> args;
+                        std::memcpy(std::data(args), record + sizeof(header), header.num_args * sizeof(Arg));
+                        auto strings = reinterpret_cast<const char *>(record + sizeof(header) + header.num_args * sizeof(Arg));
+
+                        Line line;
+                        format_record(line, header, std::data(args), strings);
+                        write(header.prio, header.tag, line.c_str());
+                    }
+
+                    tail += header.size;
+                    ring.tail.store(tail, std::memory_order_release);
+                }
+
+                auto dropped = ring.dropped.load(std::memory_order_relaxed);
+                if(dropped != ring.dropped_reported)
+                {
+                    Line line;
+                    line.append_formatted("%lu messages dropped, log ring full", dropped - ring.dropped_reported);
+                    write(ANDROID_LOG_WARN, "log_ring", line.c_str());
+                    ring.dropped_reported = dropped;
+                }
+            }
+
+            void run()
+            {
+                TRACE_THREAD_NAME("log");
+                while(true)
+                {
+                    {
+                        std::unique_lock lock(wake_mutex);
+                        wake_cv.wait(lock, [this]() { return pending.load(std::memory_order_acquire); });
+                    }
+                    pending.exchange(false, std::memory_order_acq_rel);
+                    drain_all();
+                }
+            }
+
+        public:
+            // never destroyed, see get_flusher. The thread is left to be killed when the process exits
+            Flusher()
+            {
+                std::thread(&Flusher::run, this).detach();
+            }
+            Flusher(const Flusher &) = delete;
+            Flusher & operator=(const Flusher &) = delete;
+
+            void drain_all()
+            {
+                std::scoped_lock lock(mutex);
+                for(auto & ring: rings)
+                    drain(*ring);
+                if(file)
+                    std::fflush(file);
+            }
+
+            // write out what's queued, and everything logged from now on, on the logging thread. Called at exit, when the
+            // flusher thread may not get another chance to run
+            void go_synchronous()
+            {
+                synchronous.store(true, std::memory_order_release);
+                drain_all();
+            }
+
+            void wake()
+            {
+                if(synchronous.load(std::memory_order_acquire))
+                {
+                    drain_all();
+                    return;
+                }
+
+                if(!pending.exchange(true, std::memory_order_acq_rel))
+                {
+                    // taken and released so the flusher can't miss the notify between checking pending and waiting
+                    { std::scoped_lock lock(wake_mutex); }
+                    wake_cv.notify_one();
+                }
+            }
+
+            Thread_ring * acquire_ring()
+            {
+                std::scoped_lock lock(mutex);
+                for(auto & ring: rings)
+                {
+                    if(!ring->in_use.load(std::memory_order_acquire))
+                    {
+                        ring->in_use.store(true, std::memory_order_relaxed);
+                        return ring.get();
+                    }
+                }
+                rings.push_back(std::make_unique<Thread_ring>());
+                return rings.back().get();
+            }
+
+            bool set_file(const std::string & path)
+            {
+                drain_all();
+
+                std::scoped_lock lock(mutex);
+                if(file)
+                    std::fclose(file);
+                file = nullptr;
+
+                if(std::empty(path))
+                    return true;
+
+                file = std::fopen(path.c_str(), "w");
+                return file != nullptr;
+            }
+        };
+
+        // deliberately leaked. Global objects (ie: engine and event_dispatcher in jni.cpp) log from their destructors, and
+        // may be destroyed after any static Flusher would have been
+        Flusher & get_flusher()
+        {
+            static auto flusher = []()
+            {
+                auto f = new Flusher;
+                std::atexit([]() { get_flusher().go_synchronous(); });
+                return f;
+            }();
+            return *flusher;
+        }
+
+        struct Ring_owner
+        {
+            Thread_ring * ring = nullptr;
+            ~Ring_owner()
+            {
+                if(ring)
+                    ring->in_use.store(false, std::memory_order_release);
+            }
+        };
+        thread_local Ring_owner local_ring;
+    }
+
+    void flush()
+    {
+        get_flusher().drain_all();
+    }
+
+    bool log_to_file(const std::string & path)
+    {
+        return get_flusher().set_file(path);
+    }
+
+    namespace detail
+    {
+        std::size_t fit_strings(std::size_t * sizes, std::size_t num_args, std::size_t space)
+        {
+            // every string keeps at least its terminator. space is always more than max_args
+            auto num_strings = static_cast<std::size_t>(std::count_if(sizes, sizes + num_args, [](auto size) { return size > 0; }));
+            auto available = space - num_strings;
+
+            std::size_t total = 0;
+            for(std::size_t i = 0; i < num_args; ++i)
+            {
+                if(sizes[i] == 0)
+                    continue;
+                auto chars = std::min(sizes[i] - 1, available);
+                available -= chars;
+                sizes[i] = chars + 1;
+                total += sizes[i];
+            }
+            return total;
+        }
+
+        unsigned char * reserve(int prio, std::size_t size)
+        {
+            if(!local_ring.ring)
+                local_ring.ring = get_flusher().acquire_ring();
+            auto & ring = *local_ring.ring;
+
+            auto head = ring.head.load(std::memory_order_relaxed);
+            auto offset = head % Thread_ring::capacity;
+            auto contiguous = Thread_ring::capacity - offset;
+
+            // records don't wrap, so the end of the ring is skipped over when there isn't enough room left there
+            auto padding = size > contiguous ? contiguous : 0;
+            auto full = [&]() { return head + padding + size - ring.tail.load(std::memory_order_acquire) > Thread_ring::capacity; };
+
+            // errors aren't dropped. Make room by writing out the ring here
+            if(full() && prio >= ANDROID_LOG_ERROR)
+                get_flusher().drain_all();
+
+            if(full())
+            {
+                ring.dropped.fetch_add(1, std::memory_order_relaxed);
+                return nullptr;
+            }
+
+            if(padding)
+            {
+                Record_header skip {static_cast<std::uint32_t>(padding), ANDROID_LOG_UNKNOWN, 0, nullptr, nullptr};
+                std::memcpy(std::data(ring.data) + offset, &skip, std::min(padding, sizeof(skip)));
+                head += padding;
+                offset = 0;
+            }
+
+            ring.reserved_head = head + size;
+            return std::data(ring.data) + offset;
+        }
+
+        void commit(int prio)
+        {
+            local_ring.ring->head.store(local_ring.ring->reserved_head, std::memory_order_release);
+            if(prio >= ANDROID_LOG_ERROR)
+                get_flusher().drain_all();
+            else
+                get_flusher().wake();
+        }
+    }
+}
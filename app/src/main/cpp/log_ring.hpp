@@ -0,0 +1,157 @@
+// Copyright 2022 Matthew Chandler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef INC_2050_LOG_RING_HPP
+#define INC_2050_LOG_RING_HPP
+
+// deferred log formatting. The LOG_ macros record the format string pointer and their raw arguments into a lock-free
+// ring owned by the calling thread, and a background thread formats them and writes them to the Android log (or the
+// shim's stderr, on the host), or to a file. String arguments are copied, but the format string and tag aren't, so
+// they must be string literals, or otherwise outlive the log. Messages from different threads may be written out of
+// order relative to each other. When a thread's ring is full, its new messages are dropped and counted. Errors (and
+// anything worse) are written on the logging thread before print returns, along with everything queued ahead of them,
+// since they're often followed by a throw or abort that the flusher won't get to see. Once the process starts exiting,
+// every message is written as soon as it's logged, so global destructors can still log
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+namespace log_ring
+{
+    // write out everything logged so far, on the calling thread
+    void flush();
+
+    // write to a file instead of the Android log. An empty path goes back to the Android log. Returns false if the file
+    // couldn't be opened
+    bool log_to_file(const std::string & path);
+
+    // never called. The LOG_ macros call this in dead code so format strings still get checked against their arguments
+    [[gnu::format(printf, 1, 2)]] inline void check_format(const char *, ...) {}
+
+    namespace detail
+    {
+        constexpr std::size_t max_args = 32;
+        constexpr std::size_t max_record_size = 4096; // about the longest line logcat will take
+
+        enum class Arg_kind: std::uint8_t {INT, UINT, DOUBLE, STRING, POINTER};
+
+        struct Arg
+        {
+            std::uint64_t value; // for STRING, the length of the copy that follows the args
+            Arg_kind kind;
+        };
+
+        struct Record_header
+        {
+            std::uint32_t size; // including padding to 8 bytes
+            std::uint8_t prio; // 0 (ANDROID_LOG_UNKNOWN) marks padding before the ring wraps
+            std::uint8_t num_args;
+            const char * tag;
+            const char * fmt;
+        };
+
+        // space in the calling thread's ring. nullptr when it's full. Nothing is visible to the flusher until commit
+        unsigned char * reserve(int prio, std::size_t size);
+        void commit(int prio);
+
+        // shortens string args to fit in space. sizes include the terminator, and are 0 for non-string args. Returns the
+        // total size of the copied strings
+        std::size_t fit_strings(std::size_t * sizes, std::size_t num_args, std::size_t space);
+
+        inline void put_arg(unsigned char *& out, const Arg & arg)
+        {
+            std::memcpy(out, &arg, sizeof(arg));
+            out += sizeof(arg);
+        }
+
+        template<typename T>
+        constexpr bool is_string = std::is_pointer_v<T> && std::is_same_v<std::remove_cv_t<std::remove_pointer_t<T>>, char>;
+
+        template<typename T>
+        std::size_t string_size(T value)
+        {
+            if constexpr(is_string<T>)
+                return std::strlen(value ? value : "(null)") + 1;
+            else
+                return 0;
+        }
+
+        template<typename T>
+        Arg encode(T value, std::size_t size, char *& strings)
+        {
+            if constexpr(is_string<T>)
+            {
+                std::memcpy(strings, value ? value : "(null)", size - 1);
+                strings[size - 1] = '\0';
+                strings += size;
+                return {size - 1, Arg_kind::STRING};
+            }
+            else if constexpr(std::is_same_v<T, bool>)
+                return {value, Arg_kind::INT};
+            else if constexpr(std::is_integral_v<T> && std::is_signed_v<T>)
+                return {static_cast<std::uint64_t>(static_cast<std::int64_t>(value)), Arg_kind::INT};
+            else if constexpr(std::is_integral_v<T>)
+                return {static_cast<std::uint64_t>(value), Arg_kind::UINT};
+            else if constexpr(std::is_floating_point_v<T>)
+            {
+                auto d = static_cast<double>(value);
+                std::uint64_t bits;
+                std::memcpy(&bits, &d, sizeof(bits));
+                return {bits, Arg_kind::DOUBLE};
+            }
+            else if constexpr(std::is_pointer_v<T>)
+                return {reinterpret_cast<std::uintptr_t>(value), Arg_kind::POINTER};
+            else
+                static_assert(!sizeof(T), "unsupported log argument type");
+        }
+    }
+
+    template<typename ... Args>
+    void print(int prio, const char * tag, const char * fmt, const Args & ... args)
+    {
+        using namespace detail;
+        constexpr auto num_args = sizeof...(Args);
+        static_assert(num_args <= max_args, "too many log arguments");
+
+        // arrays (ie: string literals) decay, same as through printf's ...
+        std::array<std::size_t, num_args + 1> sizes {string_size<std::decay_t<const Args &>>(args)...};
+        constexpr auto fixed_size = sizeof(Record_header) + num_args * sizeof(Arg);
+        auto size = (fixed_size + fit_strings(std::data(sizes), num_args, max_record_size - fixed_size) + 7) & ~std::size_t{7};
+
+        auto data = reserve(prio, size);
+        if(!data)
+            return;
+
+        Record_header header {static_cast<std::uint32_t>(size), static_cast<std::uint8_t>(prio), static_cast<std::uint8_t>(num_args), tag, fmt};
+        std::memcpy(data, &header, sizeof(header));
+
+        [[maybe_unused]] auto arg_data = data + sizeof(header);
+        [[maybe_unused]] auto strings = reinterpret_cast<char *>(arg_data + num_args * sizeof(Arg));
+        [[maybe_unused]] std::size_t i = 0;
+        (put_arg(arg_data, encode<std::decay_t<const Args &>>(args, sizes[i++], strings)), ...);
+
+        commit(prio);
+    }
+}
+
+#endif //INC_2050_LOG_RING_HPP
@@ -20,9 +20,21 @@
 
 #include "opengl.hpp"
 
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
 #include <system_error>
 
+#include <dirent.h>
+#include <sys/stat.h>
+#include <utime.h>
+
+#include <EGL/egl.h>
+
 #include "log.hpp"
+#include "trace.hpp"
 
 namespace detail
 {
@@ -54,8 +66,395 @@ namespace detail
     }
 }
 
+namespace gl_state
+{
+    namespace
+    {
+        // 0 is a valid binding, so use this to mean 'unknown'
+        constexpr GLuint unknown = static_cast<GLuint>(-1);
+
+        GLuint current_program = unknown;
+        GLuint current_array_buffer = unknown;
+        GLuint current_vertex_array = unknown;
+
+        using Gen_vertex_arrays_fun = void (GL_APIENTRYP)(GLsizei n, GLuint * arrays);
+        using Delete_vertex_arrays_fun = void (GL_APIENTRYP)(GLsizei n, const GLuint * arrays);
+        using Bind_vertex_array_fun = void (GL_APIENTRYP)(GLuint array);
+        Gen_vertex_arrays_fun gen_vertex_arrays = nullptr;
+        Delete_vertex_arrays_fun delete_vertex_arrays = nullptr;
+        Bind_vertex_array_fun bind_vertex_array_fun = nullptr;
+
+        Stats stats;
+    }
+
+    void init(bool gles3)
+    {
+        invalidate();
+
+        if(gles3)
+        {
+            gen_vertex_arrays = glGenVertexArrays;
+            delete_vertex_arrays = glDeleteVertexArrays;
+            bind_vertex_array_fun = glBindVertexArray;
+        }
+        else
+        {
+            auto extensions = reinterpret_cast<const char *>(glGetString(GL_EXTENSIONS));
+            if(extensions && std::strstr(extensions, "GL_OES_vertex_array_object"))
+            {
+                gen_vertex_arrays = reinterpret_cast<Gen_vertex_arrays_fun>(eglGetProcAddress("glGenVertexArraysOES"));
+                delete_vertex_arrays = reinterpret_cast<Delete_vertex_arrays_fun>(eglGetProcAddress("glDeleteVertexArraysOES"));
+                bind_vertex_array_fun = reinterpret_cast<Bind_vertex_array_fun>(eglGetProcAddress("glBindVertexArrayOES"));
+            }
+
+            if(!gen_vertex_arrays || !delete_vertex_arrays || !bind_vertex_array_fun)
+            {
+                gen_vertex_arrays = nullptr;
+                delete_vertex_arrays = nullptr;
+                bind_vertex_array_fun = nullptr;
+            }
+        }
+
+        LOG_DEBUG_PRINT("gl_state::init", "vertex array objects %s", has_vertex_arrays() ? "available" : "unavailable");
+    }
+
+    void invalidate()
+    {
+        current_program = unknown;
+        current_array_buffer = unknown;
+        current_vertex_array = unknown;
+    }
+
+    void use_program(GLuint id)
+    {
+        if(id == current_program)
+        {
+            ++stats.skipped;
+            return;
+        }
+        ++stats.calls;
+        glUseProgram(id);
+        current_program = id;
+    }
+
+    void bind_buffer(GLenum type, GLuint id)
+    {
+        // only GL_ARRAY_BUFFER is tracked. Others are either rarely used, or are part of VAO state
+        if(type == GL_ARRAY_BUFFER)
+        {
+            if(id == current_array_buffer)
+            {
+                ++stats.skipped;
+                return;
+            }
+            current_array_buffer = id;
+        }
+        ++stats.calls;
+        glBindBuffer(type, id);
+    }
+
+    void forget_program(GLuint id)
+    {
+        if(id == current_program)
+            current_program = unknown;
+    }
+    void forget_buffer(GLuint id)
+    {
+        if(id == current_array_buffer)
+            current_array_buffer = unknown;
+    }
+
+    bool has_vertex_arrays() { return gen_vertex_arrays != nullptr; }
+    GLuint gen_vertex_array()
+    {
+        GLuint id = 0;
+        gen_vertex_arrays(1, &id);
+        return id;
+    }
+    void delete_vertex_array(GLuint id)
+    {
+        if(id == current_vertex_array)
+            current_vertex_array = unknown;
+        delete_vertex_arrays(1, &id);
+    }
+    void bind_vertex_array(GLuint id)
+    {
+        if(id == current_vertex_array)
+        {
+            ++stats.skipped;
+            return;
+        }
+        ++stats.calls;
+        bind_vertex_array_fun(id);
+        current_vertex_array = id;
+    }
+
+    void count_calls(unsigned long calls) { stats.calls += calls; }
+    const Stats & get_stats() { return stats; }
+}
+
+Program_cache::Program_cache(const std::string & dir, bool gles3): dir(dir), gles3(gles3)
+{
+    GLint num_formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_formats);
+
+    if(gles3)
+    {
+        get_program_binary = glGetProgramBinary;
+        program_binary = glProgramBinary;
+    }
+    else
+    {
+        auto extensions = reinterpret_cast<const char *>(glGetString(GL_EXTENSIONS));
+        if(extensions && std::strstr(extensions, "GL_OES_get_program_binary"))
+        {
+            get_program_binary = reinterpret_cast<Get_program_binary_fun>(eglGetProcAddress("glGetProgramBinaryOES"));
+            program_binary = reinterpret_cast<Program_binary_fun>(eglGetProcAddress("glProgramBinaryOES"));
+        }
+    }
+
+    // some drivers expose the functions, but don't support any formats
+    if(num_formats <= 0 || !get_program_binary || !program_binary)
+    {
+        get_program_binary = nullptr;
+        program_binary = nullptr;
+    }
+
+    for(auto name: {GL_VENDOR, GL_RENDERER, GL_VERSION})
+    {
+        auto str = reinterpret_cast<const char *>(glGetString(name));
+        driver_id += str ? str : "";
+        driver_id += '\n';
+    }
+
+    if(is_supported())
+    {
+        mkdir(dir.c_str(), 0700);
+        prune();
+    }
+
+    LOG_DEBUG_PRINT("Program_cache::Program_cache", "program binaries %s (%d formats)", is_supported() ? "supported" : "unsupported", num_formats);
+}
+
+void Program_cache::prune() const
+{
+    struct Entry
+    {
+        std::string path;
+        std::uintmax_t size;
+        time_t mtime;
+    };
+    std::vector<Entry> entries;
+    std::uintmax_t total_size = 0;
+
+    if(auto d = opendir(dir.c_str()))
+    {
+        while(auto ent = readdir(d))
+        {
+            std::string_view name{ent->d_name};
+            auto path = dir + "/" + ent->d_name;
+
+            // left behind by a store that was interrupted before the rename
+            if(std::size(name) >= 4 && name.substr(std::size(name) - 4) == ".tmp")
+            {
+                std::remove(path.c_str());
+                continue;
+            }
+            if(std::size(name) < 4 || name.substr(std::size(name) - 4) != ".bin")
+                continue;
+
+            struct stat st;
+            if(stat(path.c_str(), &st) != 0)
+                continue;
+
+            entries.push_back({path, static_cast<std::uintmax_t>(st.st_size), st.st_mtime});
+            total_size += entries.back().size;
+        }
+        closedir(d);
+    }
+
+    // nothing built by another driver will load, so clear it all out rather than waiting for each binary to be rejected
+    auto driver_path = dir + "/" + driver_file;
+    std::ifstream driver_in(driver_path, std::ios::binary);
+    std::string stored_id{std::istreambuf_iterator<char>(driver_in), std::istreambuf_iterator<char>()};
+    driver_in.close();
+
+    std::size_t removed = 0;
+    if(stored_id != driver_id)
+    {
+        for(auto & entry: entries)
+            removed += std::remove(entry.path.c_str()) == 0;
+        entries.clear();
+        total_size = 0;
+
+        std::ofstream driver_out(driver_path, std::ios::binary);
+        driver_out << driver_id;
+    }
+
+    // loads refresh a binary's mtime, so the oldest are the least recently used
+    if(total_size > max_size)
+    {
+        std::sort(std::begin(entries), std::end(entries), [](auto & a, auto & b) { return a.mtime < b.mtime; });
+        for(auto & entry: entries)
+        {
+            if(total_size <= max_size)
+                break;
+            removed += std::remove(entry.path.c_str()) == 0;
+            total_size -= entry.size;
+        }
+    }
+
+    if(removed > 0)
+    {
+        LOG_DEBUG_PRINT("Program_cache::prune", "removed %zu cached binaries", removed);
+    }
+}
+
+std::string Program_cache::get_path(const std::vector<std::pair<std::string_view, GLenum>> & sources, const std::vector<std::string> & attribs) const
+{
+    // FNV-1a. std::hash isn't guaranteed to be stable between runs
+    std::uint64_t hash = 0xcbf29ce484222325;
+    auto add = [&hash](const void * data, std::size_t size)
+    {
+        auto bytes = static_cast<const std::uint8_t *>(data);
+        for(std::size_t i = 0; i < size; ++i)
+        {
+            hash ^= bytes[i];
+            hash *= 0x100000001b3;
+        }
+    };
+
+    add(std::data(driver_id), std::size(driver_id));
+    for(auto & source: sources)
+    {
+        add(std::data(source.first), std::size(source.first));
+        add(&source.second, sizeof(source.second));
+    }
+    for(auto & attrib: attribs)
+        add(attrib.c_str(), std::size(attrib) + 1);
+
+    char name[17];
+    std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(hash));
+    return dir + "/" + name + ".bin";
+}
+
+void Program_cache::prepare(GLuint prog) const
+{
+    if(gles3 && is_supported())
+        glProgramParameteri(prog, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+bool Program_cache::load(GLuint prog, const std::string & path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if(!file)
+        return false;
+
+    GLenum format = 0;
+    GLsizei length = 0;
+    file.read(reinterpret_cast<char *>(&format), sizeof(format));
+    file.read(reinterpret_cast<char *>(&length), sizeof(length));
+    std::vector<char> binary{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+    file.close();
+
+    // a short file is left over from an older build or a write that didn't finish
+    if(std::empty(binary) || std::size(binary) != static_cast<std::size_t>(length))
+    {
+        LOG_DEBUG_PRINT("Program_cache::load", "cached binary %s is truncated", path.c_str());
+        std::remove(path.c_str());
+        return false;
+    }
+
+    program_binary(prog, format, std::data(binary), static_cast<GLsizei>(std::size(binary)));
+
+    // binaries are rejected if the driver has been updated, among other things
+    GLint link_status = GL_FALSE;
+    glGetProgramiv(prog, GL_LINK_STATUS, &link_status);
+    if(link_status != GL_TRUE)
+    {
+        LOG_DEBUG_PRINT("Program_cache::load", "cached binary %s rejected", path.c_str());
+        std::remove(path.c_str());
+        return false;
+    }
+
+    utime(path.c_str(), nullptr);
+    return true;
+}
+
+void Program_cache::store(GLuint prog, const std::string & path) const
+{
+    GLint length = 0;
+    glGetProgramiv(prog, GL_PROGRAM_BINARY_LENGTH, &length);
+    if(length <= 0)
+        return;
+
+    std::vector<char> binary(static_cast<std::size_t>(length));
+    GLenum format = 0;
+    GLsizei written = 0;
+    get_program_binary(prog, length, &written, &format, std::data(binary));
+    if(written <= 0)
+        return;
+
+    // write next to the real path and rename over it, so a crash or full disk never leaves a partial binary to be loaded
+    auto tmp_path = path + ".tmp";
+    std::ofstream file(tmp_path, std::ios::binary);
+    file.write(reinterpret_cast<const char *>(&format), sizeof(format));
+    file.write(reinterpret_cast<const char *>(&written), sizeof(written));
+    file.write(std::data(binary), written);
+    file.close();
+    if(!file || std::rename(tmp_path.c_str(), path.c_str()) != 0)
+    {
+        LOG_ERROR_PRINT("Program_cache::store", "Could not write %s", path.c_str());
+        std::remove(tmp_path.c_str());
+    }
+}
+
+void Program_cache::record(bool hit, std::chrono::duration<float> time)
+{
+    if(hit)
+    {
+        ++stats.hits;
+        stats.load_time += time;
+    }
+    else
+    {
+        ++stats.misses;
+        stats.compile_time += time;
+    }
+}
+
 Shader_prog::Shader_prog(const std::vector<std::pair<std::string_view, GLenum>> & sources,
-            const std::vector<std::string> & attribs)
+            const std::vector<std::string> & attribs, Program_cache * cache): id(0)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    std::string cache_path;
+    if(cache && cache->is_supported())
+    {
+        cache_path = cache->get_path(sources, attribs);
+        id = glCreateProgram();
+        if(!cache->load(id, cache_path))
+        {
+            glDeleteProgram(id);
+            id = 0;
+        }
+    }
+    bool cache_hit = id != 0;
+
+    if(!cache_hit)
+        link(sources, attribs, cache);
+
+    if(!std::empty(cache_path) && !cache_hit)
+        cache->store(id, cache_path);
+
+    if(cache)
+        cache->record(cache_hit, std::chrono::steady_clock::now() - start);
+
+    get_uniforms();
+}
+
+void Shader_prog::link(const std::vector<std::pair<std::string_view, GLenum>> & sources,
+                       const std::vector<std::string> & attribs, const Program_cache * cache)
 {
     std::vector<Shader_obj> shaders;
     for(auto &source: sources)
@@ -70,6 +469,9 @@ Shader_prog::Shader_prog(const std::vector<std::pair<std::string_view, GLenum>>
     for(GLuint i = 0; i < std::size(attribs); ++i)
         glBindAttribLocation(id, i, attribs[i].c_str());
 
+    if(cache)
+        cache->prepare(id);
+
     glLinkProgram(id);
 
     GLint link_status;
@@ -87,8 +489,10 @@ Shader_prog::Shader_prog(const std::vector<std::pair<std::string_view, GLenum>>
         LOG_ERROR_PRINT("Shader_prog::Shader_proj", "Error linking shader program:\n %s", log.c_str());
         throw std::system_error(link_status, std::system_category(), "Error linking shader program:\n" + log);
     }
+}
 
-    // get uniforms
+void Shader_prog::get_uniforms()
+{
     GLint num_uniforms;
     GLint max_buff_size;
     glGetProgramiv(id, GL_ACTIVE_UNIFORMS, &num_uniforms);
@@ -109,7 +513,10 @@ Shader_prog::Shader_prog(const std::vector<std::pair<std::string_view, GLenum>>
 Shader_prog::~Shader_prog()
 {
     if(id)
+    {
+        gl_state::forget_program(id);
         glDeleteProgram(id);
+    }
 }
 Shader_prog::Shader_prog(Shader_prog && other) noexcept : uniforms(std::move(other.uniforms)), id(other.id) { other.id = 0; }
 Shader_prog & Shader_prog::operator=(Shader_prog && other) noexcept
@@ -123,7 +530,7 @@ Shader_prog & Shader_prog::operator=(Shader_prog && other) noexcept
     return *this;
 }
 
-void Shader_prog::use() const { glUseProgram(id); }
+void Shader_prog::use() const { gl_state::use_program(id); }
 GLint Shader_prog::get_uniform(const std::string & uniform) const
 {
     try
@@ -133,9 +540,14 @@ GLint Shader_prog::get_uniform(const std::string & uniform) const
     catch(std::out_of_range & e)
     {
         LOG_ERROR_PRINT("Shader_prog::get_uniform", "Could not find uniform %s: %s", uniform.c_str(), e.what());
-        return 0;
+        return -1; // setting location -1 is silently ignored
     }
 }
+GLint Shader_prog::get_uniform_optional(const std::string & uniform) const
+{
+    auto loc = uniforms.find(uniform);
+    return loc != std::end(uniforms) ? loc->second : -1;
+}
 
 Shader_prog::Shader_obj::Shader_obj(const std::string_view & src, GLenum type)
 {
@@ -185,7 +597,10 @@ GL_buffer::GL_buffer(GLenum type):type(type) { glGenBuffers(1, &id); }
 GL_buffer::~GL_buffer()
 {
     if(id)
+    {
+        gl_state::forget_buffer(id);
         glDeleteBuffers(1, &id);
+    }
 }
 GL_buffer::GL_buffer(GL_buffer && other) noexcept : id(other.id) { other.id = 0; }
 GL_buffer & GL_buffer::operator=(GL_buffer && other) noexcept
@@ -199,4 +614,153 @@ GL_buffer & GL_buffer::operator=(GL_buffer && other) noexcept
 }
 
 GLuint GL_buffer::get_id() const { return id; }
-void GL_buffer::bind() const { glBindBuffer(type, id); }
+void GL_buffer::bind() const { gl_state::bind_buffer(type, id); }
+
+GL_texture::GL_texture() { glGenTextures(1, &id); }
+GL_texture::~GL_texture()
+{
+    if(id)
+        glDeleteTextures(1, &id);
+}
+GL_texture::GL_texture(GL_texture && other) noexcept : id(other.id) { other.id = 0; }
+GL_texture & GL_texture::operator=(GL_texture && other) noexcept
+{
+    if(this != &other)
+    {
+        if(id)
+            glDeleteTextures(1, &id);
+        id = other.id;
+        other.id = 0;
+    }
+    return *this;
+}
+
+GLuint GL_texture::get_id() const { return id; }
+void GL_texture::bind() const
+{
+    gl_state::count_calls(1);
+    glBindTexture(GL_TEXTURE_2D, id);
+}
+
+Vertex_array::Vertex_array(): id(gl_state::gen_vertex_array()) {}
+Vertex_array::~Vertex_array()
+{
+    if(id)
+        gl_state::delete_vertex_array(id);
+}
+Vertex_array::Vertex_array(Vertex_array && other) noexcept : id(other.id) { other.id = 0; }
+Vertex_array & Vertex_array::operator=(Vertex_array && other) noexcept
+{
+    if(this != &other)
+    {
+        if(id)
+            gl_state::delete_vertex_array(id);
+        id = other.id;
+        other.id = 0;
+    }
+    return *this;
+}
+
+void Vertex_array::bind() const { gl_state::bind_vertex_array(id); }
+
+Streaming_buffer::Streaming_buffer(GLenum type, std::size_t initial_size, bool use_fences, std::size_t num_regions):
+    buffer(type),
+    type(type),
+    use_fences(use_fences),
+    num_regions(use_fences ? num_regions : 1),
+    region_size(initial_size),
+    fences(this->num_regions, nullptr)
+{
+    buffer.bind();
+    glBufferData(type, static_cast<GLsizeiptr>(region_size * this->num_regions), nullptr, use_fences ? GL_DYNAMIC_DRAW : GL_STREAM_DRAW);
+}
+Streaming_buffer::~Streaming_buffer()
+{
+    for(auto & f: fences)
+    {
+        if(f)
+            glDeleteSync(f);
+    }
+}
+
+void Streaming_buffer::wait_for_region(std::size_t region)
+{
+    auto & f = fences[region];
+    if(!f)
+        return;
+
+    if(glClientWaitSync(f, 0, 0) == GL_TIMEOUT_EXPIRED)
+    {
+        ++stats.stalls;
+        constexpr GLuint64 timeout = 1000000000; // 1s
+        if(glClientWaitSync(f, GL_SYNC_FLUSH_COMMANDS_BIT, timeout) == GL_TIMEOUT_EXPIRED)
+            LOG_ERROR_WRITE("Streaming_buffer::wait_for_region", "timed out waiting for GPU");
+    }
+
+    glDeleteSync(f);
+    f = nullptr;
+}
+
+GLintptr Streaming_buffer::upload(const void * data, std::size_t size)
+{
+    TRACE_SCOPE("buffer upload");
+    buffer.bind();
+    ++stats.uploads;
+    stats.bytes_uploaded += size;
+
+    if(size > region_size)
+    {
+        // reallocating orphans the old storage, so there's no need to wait on outstanding fences
+        region_size = std::max(size, 2 * region_size);
+        LOG_DEBUG_PRINT("Streaming_buffer::upload", "resized to %d x %d bytes", static_cast<int>(num_regions), static_cast<int>(region_size));
+        ++stats.reallocations;
+
+        for(auto & f: fences)
+        {
+            if(f)
+                glDeleteSync(f);
+            f = nullptr;
+        }
+
+        glBufferData(type, static_cast<GLsizeiptr>(region_size * num_regions), nullptr, use_fences ? GL_DYNAMIC_DRAW : GL_STREAM_DRAW);
+        current_region = 0;
+    }
+    else if(!use_fences)
+    {
+        // orphan the old storage so the driver doesn't have to wait on the GPU for us
+        glBufferData(type, static_cast<GLsizeiptr>(region_size), nullptr, GL_STREAM_DRAW);
+    }
+    else
+    {
+        current_region = (current_region + 1) % num_regions;
+        wait_for_region(current_region);
+    }
+
+    auto offset = static_cast<GLintptr>(current_region * region_size);
+
+    if(use_fences)
+    {
+        // we've already synchronized with the GPU, so the driver doesn't need to
+        auto dest = glMapBufferRange(type, offset, static_cast<GLsizeiptr>(size), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        if(dest)
+        {
+            std::memcpy(dest, data, size);
+            glUnmapBuffer(type);
+            return offset;
+        }
+        LOG_ERROR_WRITE("Streaming_buffer::upload", "could not map buffer");
+    }
+
+    glBufferSubData(type, offset, static_cast<GLsizeiptr>(size), data);
+    return offset;
+}
+
+void Streaming_buffer::fence()
+{
+    if(!use_fences)
+        return;
+
+    if(fences[current_region])
+        glDeleteSync(fences[current_region]);
+    fences[current_region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
@@ -21,11 +21,18 @@
 #ifndef INC_2050_OPENGL_HPP
 #define INC_2050_OPENGL_HPP
 
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
 #include <string>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
-#include <GLES2/gl2.h>
+#include <GLES3/gl3.h>
+
+#include <glm/glm.hpp>
 
 namespace detail
 {
@@ -34,15 +41,115 @@ namespace detail
 }
 #define GL_CHECK_ERROR(at) do { detail::GL_check_error(at, __FILE__, __LINE__); } while(false);
 
+// tracks what's bound so redundant binds can be skipped, and counts the state calls we make.
+// anything else that touches GL state behind our backs must be followed by invalidate()
+namespace gl_state
+{
+    struct Stats
+    {
+        unsigned long calls = 0;
+        unsigned long skipped = 0;
+    };
+
+    void init(bool gles3); // call whenever a new context is made current
+    void invalidate();
+
+    void use_program(GLuint id);
+    void bind_buffer(GLenum type, GLuint id);
+    void forget_program(GLuint id);
+    void forget_buffer(GLuint id);
+
+    bool has_vertex_arrays();
+    GLuint gen_vertex_array();
+    void delete_vertex_array(GLuint id);
+    void bind_vertex_array(GLuint id);
+
+    void count_calls(unsigned long calls);
+    const Stats & get_stats();
+}
+
+// uniform location, looked up once after linking
+template<typename T>
+class Uniform
+{
+private:
+    GLint location = -1;
+public:
+    Uniform() = default;
+    explicit Uniform(GLint location): location(location) {}
+
+    // owning program must be in use
+    void set(const T & value) const;
+    void set(const T * values, GLsizei count) const;
+};
+template<> inline void Uniform<GLfloat>::set(const GLfloat & value) const { glUniform1f(location, value); }
+template<> inline void Uniform<glm::vec2>::set(const glm::vec2 & value) const { glUniform2fv(location, 1, &value[0]); }
+template<> inline void Uniform<glm::vec4>::set(const glm::vec4 & value) const { glUniform4fv(location, 1, &value[0]); }
+template<> inline void Uniform<glm::vec4>::set(const glm::vec4 * values, GLsizei count) const { glUniform4fv(location, count, &values[0][0]); }
+template<> inline void Uniform<glm::mat3>::set(const glm::mat3 & value) const { glUniformMatrix3fv(location, 1, GL_FALSE, &value[0][0]); }
+
+// caches linked program binaries on disk, so programs don't need to be compiled again every time the context is recreated.
+// Binaries are keyed by a hash of the sources, attribute bindings, and the driver's vendor, renderer and version strings.
+// The whole cache is dropped when the driver changes, and otherwise the least recently used binaries are removed once it
+// grows past max_size
+class Program_cache
+{
+public:
+    struct Stats
+    {
+        unsigned int hits = 0;
+        unsigned int misses = 0;
+        std::chrono::duration<float> load_time{0.0f};
+        std::chrono::duration<float> compile_time{0.0f}; // includes storing the new binary
+    };
+
+private:
+    using Get_program_binary_fun = void (GL_APIENTRYP)(GLuint program, GLsizei buf_size, GLsizei * length, GLenum * binary_format, void * binary);
+    using Program_binary_fun = void (GL_APIENTRYP)(GLuint program, GLenum binary_format, const void * binary, GLsizei length);
+
+    static constexpr std::uintmax_t max_size = 2 * 1024 * 1024; // bytes
+    static constexpr const char * driver_file = "driver";
+
+    std::string dir;
+    std::string driver_id;
+    bool gles3 = false;
+    Get_program_binary_fun get_program_binary = nullptr;
+    Program_binary_fun program_binary = nullptr;
+    Stats stats;
+
+    void prune() const;
+
+public:
+    // context must be current
+    Program_cache(const std::string & dir, bool gles3);
+
+    bool is_supported() const { return get_program_binary && program_binary; }
+
+    std::string get_path(const std::vector<std::pair<std::string_view, GLenum>> & sources, const std::vector<std::string> & attribs) const;
+
+    // call before linking a program that will be stored
+    void prepare(GLuint prog) const;
+    // returns false (and removes the file) if there is no usable binary at path
+    bool load(GLuint prog, const std::string & path);
+    void store(GLuint prog, const std::string & path) const;
+
+    void record(bool hit, std::chrono::duration<float> time);
+    const Stats & get_stats() const { return stats; }
+};
+
 class Shader_prog
 {
 private:
     std::unordered_map<std::string, GLint> uniforms;
     GLuint id;
+
+    void link(const std::vector<std::pair<std::string_view, GLenum>> & sources,
+              const std::vector<std::string> & attribs, const Program_cache * cache);
+    void get_uniforms();
 public:
 
     Shader_prog(const std::vector<std::pair<std::string_view, GLenum>> & sources,
-                const std::vector<std::string> & attribs);
+                const std::vector<std::string> & attribs, Program_cache * cache = nullptr);
     ~Shader_prog();
 
     Shader_prog(const Shader_prog &) = delete;
@@ -52,6 +159,13 @@ public:
 
     void use() const;
     GLint get_uniform(const std::string & uniform) const;
+    template<typename T>
+    Uniform<T> get_uniform(const std::string & uniform) const { return Uniform<T>{get_uniform(uniform)}; }
+
+    // for uniforms only some variants of a shader declare. Returns -1 without logging if this one doesn't
+    GLint get_uniform_optional(const std::string & uniform) const;
+    template<typename T>
+    Uniform<T> get_uniform_optional(const std::string & uniform) const { return Uniform<T>{get_uniform_optional(uniform)}; }
 
     class Shader_obj
     {
@@ -85,4 +199,145 @@ public:
     void bind() const;
 };
 
+class GL_texture
+{
+private:
+    GLuint id;
+public:
+    GL_texture();
+    ~GL_texture();
+    GL_texture(const GL_texture &) = delete;
+    GL_texture & operator=(const GL_texture &) = delete;
+    GL_texture(GL_texture && other) noexcept;
+    GL_texture & operator=(GL_texture && other) noexcept;
+
+    GLuint get_id() const;
+    void bind() const; // to GL_TEXTURE_2D on the active unit
+};
+
+// vertex array object. Requires GL ES 3 or OES_vertex_array_object (see gl_state::has_vertex_arrays)
+class Vertex_array
+{
+private:
+    GLuint id;
+public:
+    Vertex_array();
+    ~Vertex_array();
+    Vertex_array(const Vertex_array &) = delete;
+    Vertex_array & operator=(const Vertex_array &) = delete;
+    Vertex_array(Vertex_array && other) noexcept;
+    Vertex_array & operator=(Vertex_array && other) noexcept;
+
+    void bind() const;
+};
+
+// buffer for data that's rewritten every frame. Round-robins between regions so the CPU can write
+// the next frame's data while the GPU is still reading the last. Uses fence syncs on GL ES 3, and orphans on GL ES 2
+class Streaming_buffer
+{
+public:
+    struct Stats
+    {
+        unsigned long uploads = 0;
+        unsigned long stalls = 0; // times we had to wait for the GPU to finish with a region
+        unsigned long reallocations = 0;
+        unsigned long long bytes_uploaded = 0;
+    };
+
+private:
+    GL_buffer buffer;
+    GLenum type;
+    const bool use_fences;
+    const std::size_t num_regions;
+    std::size_t region_size = 0;
+    std::size_t current_region = 0;
+    std::vector<GLsync> fences;
+    Stats stats;
+
+    void wait_for_region(std::size_t region);
+
+public:
+    Streaming_buffer(GLenum type, std::size_t initial_size, bool use_fences, std::size_t num_regions = 3);
+    ~Streaming_buffer();
+    Streaming_buffer(const Streaming_buffer &) = delete;
+    Streaming_buffer & operator=(const Streaming_buffer &) = delete;
+
+    // copy data into the next free region, growing if needed. Leaves the buffer bound, and returns the offset the data was written to
+    GLintptr upload(const void * data, std::size_t size);
+    // call after the draw calls that read the last upload have been issued
+    void fence();
+
+    const Stats & get_stats() const { return stats; }
+    std::size_t get_current_region() const { return current_region; }
+};
+
+template<typename T> struct GL_type;
+template<> struct GL_type<GLfloat>  { constexpr static GLenum value = GL_FLOAT; };
+template<> struct GL_type<GLshort>  { constexpr static GLenum value = GL_SHORT; };
+template<> struct GL_type<GLushort> { constexpr static GLenum value = GL_UNSIGNED_SHORT; };
+template<> struct GL_type<GLbyte>   { constexpr static GLenum value = GL_BYTE; };
+template<> struct GL_type<GLubyte>  { constexpr static GLenum value = GL_UNSIGNED_BYTE; };
+
+// one vertex attribute, made of Count components of type T
+template<typename T, GLint Count, GLboolean Normalized = GL_FALSE>
+struct Vertex_attrib
+{
+    using value_type = std::array<T, Count>;
+    constexpr static GLint count = Count;
+    constexpr static GLenum gl_type = GL_type<T>::value;
+    constexpr static GLboolean normalized = Normalized;
+    constexpr static std::size_t size = sizeof(value_type);
+};
+
+// interleaved vertex format, described once at compile time.
+// Generates both the CPU-side packing and the matching glVertexAttribPointer calls
+template<typename ... Attribs>
+class Vertex_layout
+{
+private:
+    constexpr static std::array<std::size_t, sizeof...(Attribs)> offsets = []()
+    {
+        std::array<std::size_t, sizeof...(Attribs)> offsets{};
+        std::size_t offset = 0, i = 0;
+        ((offsets[i++] = offset, offset += Attribs::size), ...);
+        return offsets;
+    }();
+
+public:
+    // padded to keep every vertex 4-byte aligned
+    constexpr static std::size_t stride = ((Attribs::size + ...) + 3) / 4 * 4;
+
+    static void pack(void * dest, const typename Attribs::value_type & ... values)
+    {
+        auto bytes = static_cast<std::uint8_t *>(dest);
+        std::size_t i = 0;
+        (std::memcpy(bytes + offsets[i++], std::data(values), sizeof(values)), ...);
+    }
+
+    // attributes are assigned to consecutive locations, starting at first_location. Buffer must already be bound
+    static void enable(GLuint first_location = 0, GLintptr buffer_offset = 0)
+    {
+        gl_state::count_calls(2 * sizeof...(Attribs));
+        GLuint i = 0;
+        ((glEnableVertexAttribArray(first_location + i),
+          glVertexAttribPointer(first_location + i, Attribs::count, Attribs::gl_type, Attribs::normalized,
+                                static_cast<GLsizei>(stride), reinterpret_cast<GLvoid *>(buffer_offset + offsets[i])),
+          ++i), ...);
+    }
+    static void disable(GLuint first_location = 0)
+    {
+        gl_state::count_calls(sizeof...(Attribs));
+        for(GLuint i = 0; i < sizeof...(Attribs); ++i)
+            glDisableVertexAttribArray(first_location + i);
+    }
+
+    // GL ES 3.0 only
+    static void set_divisor(GLuint divisor, GLuint first_location = 0)
+    {
+        gl_state::count_calls(sizeof...(Attribs));
+        for(GLuint i = 0; i < sizeof...(Attribs); ++i)
+            glVertexAttribDivisor(first_location + i, divisor);
+    }
+};
+
 #endif //INC_2050_OPENGL_HPP
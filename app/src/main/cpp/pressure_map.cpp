@@ -0,0 +1,186 @@
+// Copyright 2022 Matthew Chandler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "pressure_map.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "log.hpp"
+
+Pressure_map::Pressure_map(float win_size):
+    win_size(win_size),
+    cell_size(win_size / static_cast<float>(grid_dim)),
+    inv_saturation(1.0f / (saturation * cell_size * cell_size))
+{}
+
+void Pressure_map::activate_row(std::size_t row)
+{
+    if(!active_rows[row])
+    {
+        active_rows[row] = true;
+        ++num_active_rows;
+    }
+}
+
+void Pressure_map::advance(float dt)
+{
+    time += dt;
+    step_dt = dt;
+}
+
+void Pressure_map::add(const glm::vec2 & pos, float compression)
+{
+    auto cell_coord = [this](float x)
+    {
+        return std::min(static_cast<std::size_t>(std::max(x, 0.0f) / cell_size), grid_dim - 1);
+    };
+    auto row = cell_coord(pos.y);
+    auto & cell = cells[row * grid_dim + cell_coord(pos.x)];
+
+    cell.value = cell.value * std::exp(static_cast<float>(cell.stamp - time) / decay_time) + compression * step_dt;
+    cell.stamp = time;
+    activate_row(row);
+}
+
+void Pressure_map::clear()
+{
+    // texels are left for draw to zero out, so the texture gets updated too
+    std::fill(std::begin(cells), std::end(cells), Cell{});
+    for(std::size_t row = 0; row < grid_dim; ++row)
+        activate_row(row);
+}
+
+void Pressure_map::init(const std::string_view & vert_src, const std::string_view & frag_src, Program_cache * cache)
+{
+    prog = std::make_unique<Shader_prog>(std::vector<std::pair<std::string_view, GLenum>>{{vert_src, GL_VERTEX_SHADER}, {frag_src, GL_FRAGMENT_SHADER}},
+                                         std::vector<std::string>{"corner"}, cache);
+    projection_uniform = prog->get_uniform<glm::mat3>("projection");
+    win_size_uniform = prog->get_uniform<GLfloat>("win_size");
+    prog->use();
+    glUniform1i(prog->get_uniform("pressure"), 0);
+    win_size_uniform.set(win_size);
+
+    corner_vbo = std::make_unique<GL_buffer>(GL_ARRAY_BUFFER);
+    corner_vbo->bind();
+    std::vector<std::uint8_t> corner_data(4 * Corner::stride);
+    const GLubyte corners[4][2] = {{0, 0}, {1, 0}, {0, 1}, {1, 1}}; // triangle strip
+    for(std::size_t i = 0; i < 4; ++i)
+        Corner::pack(&corner_data[i * Corner::stride], {corners[i][0], corners[i][1]});
+    glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(std::size(corner_data)), std::data(corner_data), GL_STATIC_DRAW);
+
+    // filtered, so the coarse grid comes out as a smooth gradient
+    texture = std::make_unique<GL_texture>();
+    texture->bind();
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, grid_dim, grid_dim, 0, GL_ALPHA, GL_UNSIGNED_BYTE, std::data(texels));
+
+    drawn_time = -1.0;
+
+    GL_CHECK_ERROR("Pressure_map::init");
+}
+
+void Pressure_map::destroy()
+{
+    prog.reset();
+    texture.reset();
+    corner_vbo.reset();
+}
+
+void Pressure_map::resize(const glm::mat3 & projection)
+{
+    prog->use();
+    projection_uniform.set(projection);
+}
+
+std::size_t Pressure_map::draw()
+{
+    // decay and requantize the rows that might have changed, and find the range that did
+    std::size_t first_changed = grid_dim, last_changed = 0;
+    for(std::size_t row = 0; row < grid_dim && num_active_rows > 0; ++row)
+    {
+        if(!active_rows[row])
+            continue;
+
+        bool any_pressure = false;
+        for(std::size_t i = row * grid_dim; i < (row + 1) * grid_dim; ++i)
+        {
+            auto & cell = cells[i];
+            GLubyte texel = 0;
+            if(cell.value > 0.0f)
+            {
+                cell.value *= std::exp(static_cast<float>(cell.stamp - time) / decay_time);
+                cell.stamp = time;
+                texel = static_cast<GLubyte>(std::lround(255.0f * (1.0f - std::exp(-cell.value * inv_saturation))));
+                if(texel == 0)
+                    cell.value = 0.0f; // too faint to see. Drop it so the row can go idle
+            }
+
+            if(texel != texels[i])
+            {
+                texels[i] = texel;
+                first_changed = std::min(first_changed, row);
+                last_changed = row;
+            }
+            any_pressure = any_pressure || texel != 0;
+        }
+
+        if(!any_pressure)
+        {
+            active_rows[row] = false;
+            --num_active_rows;
+        }
+    }
+
+    std::size_t bytes = 0;
+    glActiveTexture(GL_TEXTURE0);
+    texture->bind();
+    if(first_changed <= last_changed)
+    {
+        auto num_rows = last_changed - first_changed + 1;
+        bytes = num_rows * grid_dim;
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, static_cast<GLint>(first_changed), grid_dim, static_cast<GLsizei>(num_rows),
+                        GL_ALPHA, GL_UNSIGNED_BYTE, &texels[first_changed * grid_dim]);
+
+        ++stats.uploads;
+        stats.rows_uploaded += num_rows;
+        stats.bytes_uploaded += bytes;
+    }
+    drawn_time = time;
+    ++stats.frames;
+
+    // nothing to see, so skip the fill
+    if(num_active_rows == 0)
+        return bytes;
+
+    prog->use();
+    corner_vbo->bind();
+    Corner::enable();
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    Corner::disable();
+
+    return bytes;
+}
@@ -0,0 +1,100 @@
+// Copyright 2022 Matthew Chandler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef INC_2050_PRESSURE_MAP_HPP
+#define INC_2050_PRESSURE_MAP_HPP
+
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "opengl.hpp"
+
+// coarse grid of recent collision compression over the arena, drawn as a translucent overlay to show where the pile is jammed.
+// Decay is applied lazily when a cell is next touched or drawn, so each physics step costs O(contacts). Drawing only
+// requantizes rows that still have any pressure, and uploads the range of rows that changed in one glTexSubImage2D
+class Pressure_map
+{
+public:
+    struct Stats
+    {
+        unsigned long frames = 0;
+        unsigned long uploads = 0;
+        unsigned long rows_uploaded = 0;
+        unsigned long long bytes_uploaded = 0;
+    };
+
+private:
+    constexpr static std::size_t grid_dim = 32;
+    constexpr static float decay_time = 0.5f; // s. time constant of the exponential decay
+    constexpr static float saturation = 0.0005f; // compression * s per square world unit that's drawn at ~63% intensity
+
+    struct Cell
+    {
+        float value = 0.0f; // compression * s, as of stamp
+        double stamp = 0.0;
+    };
+
+    float win_size;
+    float cell_size;
+    float inv_saturation; // per cell
+    double time = 0.0; // simulation time, s
+    double drawn_time = -1.0;
+    float step_dt = 0.0f;
+
+    std::vector<Cell> cells = std::vector<Cell>(grid_dim * grid_dim);
+    std::vector<GLubyte> texels = std::vector<GLubyte>(grid_dim * grid_dim);
+    std::vector<bool> active_rows = std::vector<bool>(grid_dim); // rows with any nonzero cells or texels
+    std::size_t num_active_rows = 0;
+    void activate_row(std::size_t row);
+
+    using Corner = Vertex_layout<Vertex_attrib<GLubyte, 2>>;
+    std::unique_ptr<Shader_prog> prog;
+    Uniform<glm::mat3> projection_uniform;
+    Uniform<GLfloat> win_size_uniform;
+    std::unique_ptr<GL_texture> texture;
+    std::unique_ptr<GL_buffer> corner_vbo;
+
+    Stats stats;
+
+public:
+    explicit Pressure_map(float win_size);
+
+    // call once per physics step, before adding that step's contacts
+    void advance(float dt);
+    // compression from a contact at pos, in world coordinates
+    void add(const glm::vec2 & pos, float compression);
+    void clear();
+
+    // context must be current
+    void init(const std::string_view & vert_src, const std::string_view & frag_src, Program_cache * cache = nullptr);
+    void destroy();
+    void resize(const glm::mat3 & projection);
+
+    bool needs_render() const { return num_active_rows > 0 && time != drawn_time; } // still fading
+    std::size_t draw(); // returns bytes uploaded
+
+    const Stats & get_stats() const { return stats; }
+};
+
+#endif //INC_2050_PRESSURE_MAP_HPP
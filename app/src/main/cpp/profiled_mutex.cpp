@@ -0,0 +1,109 @@
+// Copyright 2022 Matthew Chandler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "profiled_mutex.hpp"
+
+#include <cstring>
+
+#include "log.hpp"
+#include "trace.hpp"
+
+namespace
+{
+    constexpr std::size_t unknown_site = static_cast<std::size_t>(-1);
+
+    std::uint64_t ns_since(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end)
+    {
+        return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+    }
+}
+
+Profiled_mutex::Lock::Lock(Profiled_mutex & mutex, const char * site): mutex(mutex), site(site), site_index(unknown_site)
+{
+    lock();
+}
+
+Profiled_mutex::Lock::Lock(Profiled_mutex & mutex, const char * site, std::defer_lock_t): mutex(mutex), site(site), site_index(unknown_site)
+{}
+
+Profiled_mutex::Lock::~Lock()
+{
+    if(owns)
+        unlock();
+}
+
+void Profiled_mutex::Lock::lock()
+{
+    TRACE_SCOPE("mutex wait");
+
+    auto wait_start = std::chrono::steady_clock::now();
+    mutex.mutex.lock();
+    hold_start = std::chrono::steady_clock::now();
+    owns = true;
+
+    if(site_index == unknown_site)
+        site_index = mutex.find_site(site);
+    mutex.sites[site_index].wait.add(ns_since(wait_start, hold_start));
+}
+
+void Profiled_mutex::Lock::unlock()
+{
+    mutex.sites[site_index].hold.add(ns_since(hold_start, std::chrono::steady_clock::now()));
+    owns = false;
+    mutex.mutex.unlock();
+}
+
+Profiled_mutex::Profiled_mutex()
+{
+    // enough for every site, so the lookup never reallocates
+    sites.reserve(32);
+}
+
+// mutex must be held
+std::size_t Profiled_mutex::find_site(const char * site)
+{
+    for(std::size_t i = 0; i < std::size(sites); ++i)
+    {
+        if(sites[i].name == site || std::strcmp(sites[i].name, site) == 0)
+            return i;
+    }
+
+    sites.push_back({site, {}, {}});
+    return std::size(sites) - 1;
+}
+
+std::vector<Profiled_mutex::Site_stats> Profiled_mutex::get_report()
+{
+    std::scoped_lock lock(mutex);
+    return sites;
+}
+
+void Profiled_mutex::log_report([[maybe_unused]] const char * tag)
+{
+#ifndef NDEBUG
+    for(auto & site: get_report())
+    {
+        LOG_DEBUG_PRINT(tag, "lock %s: %lu locks. wait: mean %.3f ms, p99 < %.3f ms, max %.3f ms. hold: mean %.3f ms, p99 < %.3f ms, max %.3f ms, total %.1f ms",
+                        site.name, site.wait.get_count(),
+                        site.wait.mean_ms(), site.wait.percentile_ms(0.99f), site.wait.max_ms(),
+                        site.hold.mean_ms(), site.hold.percentile_ms(0.99f), site.hold.max_ms(), site.hold.total_ms());
+    }
+#endif
+}
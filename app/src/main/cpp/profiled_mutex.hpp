@@ -0,0 +1,79 @@
+// Copyright 2022 Matthew Chandler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef INC_2050_PROFILED_MUTEX_HPP
+#define INC_2050_PROFILED_MUTEX_HPP
+
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+#include "histogram.hpp"
+
+// a mutex that records, for each call site, how long callers waited to acquire it and how long they held it.
+// Stats are only updated while the mutex is held, so they need no synchronization of their own.
+// Use with std::condition_variable_any, so time spent waiting on the condition isn't counted as holding the lock
+class Profiled_mutex
+{
+public:
+    struct Site_stats
+    {
+        const char * name;
+        Time_histogram wait;
+        Time_histogram hold;
+    };
+
+    // like std::unique_lock, tagged with the call site. site must be a string literal
+    class Lock
+    {
+    private:
+        Profiled_mutex & mutex;
+        const char * site;
+        std::size_t site_index;
+        bool owns = false;
+        std::chrono::steady_clock::time_point hold_start;
+
+    public:
+        Lock(Profiled_mutex & mutex, const char * site);
+        Lock(Profiled_mutex & mutex, const char * site, std::defer_lock_t);
+        ~Lock();
+        Lock(const Lock &) = delete;
+        Lock & operator=(const Lock &) = delete;
+
+        void lock();
+        void unlock();
+        bool owns_lock() const { return owns; }
+    };
+
+private:
+    std::mutex mutex;
+    std::vector<Site_stats> sites;
+
+    std::size_t find_site(const char * site);
+
+public:
+    Profiled_mutex();
+
+    // copy of every call site's stats so far
+    std::vector<Site_stats> get_report();
+    void log_report(const char * tag);
+};
+
+#endif //INC_2050_PROFILED_MUTEX_HPP
@@ -0,0 +1,55 @@
+// Copyright 2022 Matthew Chandler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef INC_2050_SDF_ATLAS_HPP
+#define INC_2050_SDF_ATLAS_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+// layout of the signed distance field glyph atlas asset. Written on the build machine by tools/sdf_atlas,
+// and read straight out of the asset buffer at runtime, so keep everything trivially copyable
+namespace sdf_atlas
+{
+    constexpr char magic[4] = {'S', 'D', 'F', '1'};
+    constexpr std::size_t num_glyphs = 10; // '0' - '9'
+
+    struct Glyph
+    {
+        float bearing[2]; // offset from pen position to the top left of the glyph's box, y down, in atlas pixels
+        float size[2];
+        float advance;
+        float uv_min[2];
+        float uv_max[2];
+    };
+
+    struct Header
+    {
+        char magic[4];
+        std::uint32_t width;
+        std::uint32_t height;
+        float em_size; // pixel size glyphs were rendered at
+        float spread; // distance, in atlas pixels, covered by each half of the 0-255 range. 128 is the glyph's edge
+        Glyph glyphs[num_glyphs];
+    };
+    // followed by width * height bytes of distance data
+}
+
+#endif //INC_2050_SDF_ATLAS_HPP
@@ -0,0 +1,86 @@
+// Copyright 2022 Matthew Chandler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "sensor.hpp"
+
+#include <algorithm>
+
+#include "log.hpp"
+
+Accelerometer_source::Accelerometer_source(ASensorManager * sensor_mgr): sensor_mgr(sensor_mgr)
+{
+    sensor_queue = ASensorManager_createEventQueue(sensor_mgr, ALooper_prepare(ALOOPER_PREPARE_ALLOW_NON_CALLBACKS), sensor_ident, nullptr, nullptr);
+    if(!sensor_queue)
+        __android_log_assert("Could not prepare queue for gravity sensor", "Accelerometer_source::Accelerometer_source", nullptr);
+
+    accelerometer_sensor = ASensorManager_getDefaultSensor(sensor_mgr, ASENSOR_TYPE_ACCELEROMETER);
+
+    if(!accelerometer_sensor)
+        __android_log_assert("Could not get Accelerometer Sensor", "Accelerometer_source::Accelerometer_source", nullptr);
+}
+Accelerometer_source::~Accelerometer_source()
+{
+    disable();
+
+    if(ASensorManager_destroyEventQueue(sensor_mgr, sensor_queue) != 0)
+        __android_log_assert("Could not destroy gravity sensor queue", "Accelerometer_source::~Accelerometer_source", nullptr);
+}
+
+void Accelerometer_source::enable()
+{
+    if(enabled)
+        return;
+
+    auto sampling_period = std::max(sampling_period_us, ASensor_getMinDelay(accelerometer_sensor));
+
+#if __ANDROID_API__ >= __ANDROID_API_O__
+    if(ASensorEventQueue_registerSensor(sensor_queue, accelerometer_sensor, sampling_period, max_batch_latency_us) != 0)
+        __android_log_assert("Could not enable gravity sensor", "Accelerometer_source::enable", nullptr);
+#else
+    if(ASensorEventQueue_enableSensor(sensor_queue, accelerometer_sensor) != 0)
+        __android_log_assert("Could not enable gravity sensor", "Accelerometer_source::enable", nullptr);
+    ASensorEventQueue_setEventRate(sensor_queue, accelerometer_sensor, sampling_period);
+#endif
+
+    enabled = true;
+}
+void Accelerometer_source::disable()
+{
+    if(!enabled)
+        return;
+
+    if(ASensorEventQueue_disableSensor(sensor_queue, accelerometer_sensor) != 0)
+        __android_log_assert("Could not disable gravity sensor", "Accelerometer_source::disable", nullptr);
+
+    enabled = false;
+}
+
+void Accelerometer_source::read(std::vector<Gravity_sample> & samples)
+{
+    ssize_t num_events;
+    while((num_events = ASensorEventQueue_getEvents(sensor_queue, std::data(events), std::size(events))) > 0)
+    {
+        for(ssize_t i = 0; i < num_events; ++i)
+        {
+            if(events[i].type == ASENSOR_TYPE_ACCELEROMETER)
+                samples.push_back({events[i].timestamp, {events[i].vector.x, -events[i].vector.y}});
+        }
+    }
+}
@@ -0,0 +1,57 @@
+// Copyright 2022 Matthew Chandler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef INC_2050_SENSOR_HPP
+#define INC_2050_SENSOR_HPP
+
+#include <cstdint>
+#include <vector>
+
+#include <android/sensor.h>
+
+#include "gravity.hpp"
+
+// reads from the device accelerometer. must be created on the thread that will call read()
+class Accelerometer_source final: public Gravity_source
+{
+private:
+    ASensorManager * sensor_mgr;
+    const ASensor * accelerometer_sensor;
+    ASensorEventQueue * sensor_queue;
+    const int sensor_ident = 1;
+    bool enabled = false;
+
+    std::vector<ASensorEvent> events = std::vector<ASensorEvent>(32); // scratch buffer for batched events
+
+public:
+    constexpr static std::int32_t sampling_period_us = 10000;
+    constexpr static std::int64_t max_batch_latency_us = 20000;
+
+    explicit Accelerometer_source(ASensorManager * sensor_mgr);
+    ~Accelerometer_source() override;
+    Accelerometer_source(const Accelerometer_source &) = delete;
+    Accelerometer_source & operator=(const Accelerometer_source &) = delete;
+
+    void enable() override;
+    void disable() override;
+    void read(std::vector<Gravity_sample> & samples) override;
+};
+
+#endif //INC_2050_SENSOR_HPP
@@ -0,0 +1,107 @@
+// Copyright 2022 Matthew Chandler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef INC_2050_SEQLOCK_HPP
+#define INC_2050_SEQLOCK_HPP
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// sequence lock for one writer at a time, and any number of readers. Readers never block the writer, and retry if they overlap a write.
+// get_data() can be shared with code that doesn't know about std::atomic (ie: a direct ByteBuffer in Kotlin). Layout, in native byte order:
+//   0: uint32 sequence. Odd while a write is in progress
+//   4: T, as 32 bit words
+// Readers must load the sequence, then the value, then the sequence again, and retry if it was odd or has changed.
+// No Android dependencies, so it can be built and tested on the host
+template<typename T>
+class Seqlock
+{
+    static_assert(std::is_trivially_copyable_v<T>, "Seqlock values are copied bytewise");
+    static_assert(sizeof(T) % sizeof(std::uint32_t) == 0, "Seqlock values must be made of 32 bit words");
+    static_assert(std::atomic<std::uint32_t>::is_always_lock_free && sizeof(std::atomic<std::uint32_t>) == sizeof(std::uint32_t),
+                  "Shared layout needs plain 32 bit atomics");
+
+private:
+    constexpr static std::size_t num_words = sizeof(T) / sizeof(std::uint32_t);
+
+    struct Block
+    {
+        std::atomic<std::uint32_t> sequence {0};
+        std::array<std::atomic<std::uint32_t>, num_words> words {};
+    };
+    Block block;
+
+public:
+    Seqlock() = default;
+    explicit Seqlock(const T & value) { write(value); }
+    Seqlock(const Seqlock &) = delete;
+    Seqlock & operator=(const Seqlock &) = delete;
+
+    // writes must not overlap each other (ie: writers hold the same mutex)
+    void write(const T & value)
+    {
+        std::array<std::uint32_t, num_words> words;
+        std::memcpy(std::data(words), &value, sizeof(T));
+
+        auto sequence = block.sequence.load(std::memory_order_relaxed);
+        block.sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        for(std::size_t i = 0; i < num_words; ++i)
+            block.words[i].store(words[i], std::memory_order_relaxed);
+
+        block.sequence.store(sequence + 2, std::memory_order_release);
+    }
+
+    // returns false if a write was in progress, leaving value untouched
+    bool try_read(T & value) const
+    {
+        auto sequence = block.sequence.load(std::memory_order_acquire);
+        if(sequence & 1u)
+            return false;
+
+        std::array<std::uint32_t, num_words> words;
+        for(std::size_t i = 0; i < num_words; ++i)
+            words[i] = block.words[i].load(std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if(block.sequence.load(std::memory_order_relaxed) != sequence)
+            return false;
+
+        std::memcpy(&value, std::data(words), sizeof(T));
+        return true;
+    }
+
+    T read() const
+    {
+        T value;
+        while(!try_read(value))
+            ;
+        return value;
+    }
+
+    void * get_data() { return &block; }
+    constexpr static std::size_t get_size() { return sizeof(Block); }
+};
+
+#endif //INC_2050_SEQLOCK_HPP
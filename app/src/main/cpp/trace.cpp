@@ -0,0 +1,208 @@
+// Copyright 2022 Matthew Chandler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "trace.hpp"
+
+#ifdef ENABLE_TRACING
+
+#include <pthread.h>
+
+#ifdef __ANDROID__
+
+#include <dlfcn.h>
+
+#else
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#endif
+
+namespace trace
+{
+#ifdef __ANDROID__
+    namespace
+    {
+        // ATrace is API 23+, so look it up at runtime rather than raising minSdk
+        struct ATrace_funs
+        {
+            using Is_enabled_fun = bool (*)();
+            using Begin_section_fun = void (*)(const char * section_name);
+            using End_section_fun = void (*)();
+
+            Is_enabled_fun is_enabled = nullptr;
+            Begin_section_fun begin_section = nullptr;
+            End_section_fun end_section = nullptr;
+
+            ATrace_funs()
+            {
+                auto lib = dlopen("libandroid.so", RTLD_NOW | RTLD_LOCAL);
+                if(!lib)
+                    return;
+
+                is_enabled = reinterpret_cast<Is_enabled_fun>(dlsym(lib, "ATrace_isEnabled"));
+                begin_section = reinterpret_cast<Begin_section_fun>(dlsym(lib, "ATrace_beginSection"));
+                end_section = reinterpret_cast<End_section_fun>(dlsym(lib, "ATrace_endSection"));
+
+                if(!is_enabled || !begin_section || !end_section)
+                    is_enabled = nullptr;
+            }
+        };
+
+        const ATrace_funs & get_atrace()
+        {
+            static const ATrace_funs atrace;
+            return atrace;
+        }
+    }
+
+    // ATrace sections must nest, and capture can start or stop mid-span, so each scope remembers whether its own begin was sent
+    bool begin(const char * name, std::int64_t &)
+    {
+        auto & atrace = get_atrace();
+        if(!atrace.is_enabled || !atrace.is_enabled())
+            return false;
+
+        atrace.begin_section(name);
+        return true;
+    }
+
+    void end(const char *, std::int64_t)
+    {
+        get_atrace().end_section();
+    }
+
+    void set_thread_name(const char * name)
+    {
+        pthread_setname_np(pthread_self(), name);
+    }
+
+    bool write_chrome_json(const std::string &)
+    {
+        return false;
+    }
+#else
+    namespace
+    {
+        struct Event
+        {
+            const char * name;
+            std::int64_t start; // ns
+            std::int64_t duration; // ns
+        };
+
+        // written only by its own thread. Once full, the oldest spans are overwritten
+        struct Thread_buffer
+        {
+            constexpr static std::size_t size = 1 << 14;
+            std::array<Event, size> events;
+            std::atomic<std::size_t> head {0};
+            int tid = 0;
+            std::string name;
+        };
+
+        // buffers outlive their threads, so spans from finished threads can still be written out. Only locked when a
+        // thread records its first span, and when writing
+        std::mutex registry_mutex;
+        std::vector<std::unique_ptr<Thread_buffer>> registry;
+        thread_local Thread_buffer * local_buffer = nullptr;
+
+        Thread_buffer & get_local_buffer()
+        {
+            if(!local_buffer)
+            {
+                std::scoped_lock lock(registry_mutex);
+                registry.push_back(std::make_unique<Thread_buffer>());
+                local_buffer = registry.back().get();
+                local_buffer->tid = static_cast<int>(std::size(registry));
+            }
+            return *local_buffer;
+        }
+
+        std::int64_t now()
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+    }
+
+    bool begin(const char *, std::int64_t & start)
+    {
+        start = now();
+        return true;
+    }
+
+    void end(const char * name, std::int64_t start)
+    {
+        auto & buffer = get_local_buffer();
+        auto head = buffer.head.load(std::memory_order_relaxed);
+        buffer.events[head % Thread_buffer::size] = {name, start, now() - start};
+        buffer.head.store(head + 1, std::memory_order_release);
+    }
+
+    void set_thread_name(const char * name)
+    {
+        pthread_setname_np(pthread_self(), name);
+
+        auto & buffer = get_local_buffer();
+        std::scoped_lock lock(registry_mutex);
+        buffer.name = name;
+    }
+
+    bool write_chrome_json(const std::string & path)
+    {
+        auto file = std::fopen(path.c_str(), "w");
+        if(!file)
+            return false;
+
+        std::scoped_lock lock(registry_mutex);
+
+        std::fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", file);
+        bool first = true;
+        auto separator = [&first]() { auto sep = first ? "" : ",\n"; first = false; return sep; };
+
+        for(auto & buffer: registry)
+        {
+            if(!std::empty(buffer->name))
+                std::fprintf(file, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                             separator(), buffer->tid, buffer->name.c_str());
+
+            auto head = buffer->head.load(std::memory_order_acquire);
+            auto tail = head > Thread_buffer::size ? head - Thread_buffer::size : 0;
+            for(auto i = tail; i < head; ++i)
+            {
+                auto & event = buffer->events[i % Thread_buffer::size];
+                // complete events, with times in us
+                std::fprintf(file, "%s{\"ph\":\"X\",\"name\":\"%s\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                             separator(), event.name, buffer->tid, 1.0e-3 * static_cast<double>(event.start), 1.0e-3 * static_cast<double>(event.duration));
+            }
+        }
+
+        std::fputs("\n]}\n", file);
+        return std::fclose(file) == 0;
+    }
+#endif
+}
+
+#endif // ENABLE_TRACING
@@ -0,0 +1,73 @@
+// Copyright 2022 Matthew Chandler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef INC_2050_TRACE_HPP
+#define INC_2050_TRACE_HPP
+
+// scoped timeline spans, for seeing where each thread's time goes. Only recorded when built with ENABLE_TRACING:
+// on Android spans are forwarded to ATrace (capture with systrace or Perfetto), elsewhere (ie: tools/headless) they're
+// kept in per-thread ring buffers that can be written out as Chrome trace JSON for chrome://tracing or ui.perfetto.dev.
+// Without ENABLE_TRACING, the macros compile to nothing
+//   TRACE_SCOPE("name"); // name must be a string literal, or otherwise outlive the trace
+
+#ifdef ENABLE_TRACING
+
+#include <cstdint>
+#include <string>
+
+namespace trace
+{
+    // sets the start time, in ns. Returns false if nothing was begun (ie: ATrace isn't capturing), in which case don't call end
+    bool begin(const char * name, std::int64_t & start);
+    void end(const char * name, std::int64_t start);
+
+    void set_thread_name(const char * name);
+
+    // host only, returns false on Android. Call while traced threads are quiet, or their most recent spans may be torn
+    bool write_chrome_json(const std::string & path);
+
+    class Scope
+    {
+    private:
+        const char * name;
+        std::int64_t start = 0;
+        bool began;
+
+    public:
+        explicit Scope(const char * name): name(name), began(begin(name, start)) {}
+        ~Scope() { if(began) end(name, start); }
+        Scope(const Scope &) = delete;
+        Scope & operator=(const Scope &) = delete;
+    };
+}
+
+#define TRACE_CONCAT_IMPL(A, B) A##B
+#define TRACE_CONCAT(A, B) TRACE_CONCAT_IMPL(A, B)
+#define TRACE_SCOPE(NAME) trace::Scope TRACE_CONCAT(trace_scope_, __LINE__){NAME}
+#define TRACE_THREAD_NAME(NAME) trace::set_thread_name(NAME)
+
+#else
+
+#define TRACE_SCOPE(NAME)
+#define TRACE_THREAD_NAME(NAME)
+
+#endif
+
+#endif //INC_2050_TRACE_HPP
@@ -20,9 +20,16 @@
 
 #include "world.hpp"
 
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <utility>
+
 #include "color.hpp"
 #include "jni.hpp"
 #include "log.hpp"
+#include "trace.hpp"
 
 const float pi = static_cast<float>(M_PI);
 
@@ -38,7 +45,7 @@ glm::mat3 ortho3x3(float left, float right, float bottom, float top)
 
 glm::vec2 World::text_coord_transform(const glm::vec2 & coord)
 {
-    float scale = std::min(screen_size.x, screen_size.y) / win_size;
+    float scale = get_pixel_scale();
     glm::vec2 offset
     {
         (screen_size.x >= screen_size.y) ? (screen_size.x - screen_size.y) / 2.0f : 0.0f,
@@ -47,13 +54,30 @@ glm::vec2 World::text_coord_transform(const glm::vec2 & coord)
     return scale * coord + offset;
 }
 
-World::World(AAssetManager * asset_manager, bool gravity_mode) : gravity_mode(gravity_mode)
+World::World(AAssetManager * asset_manager, bool gravity_mode, const Sandbox_config & sandbox) : gravity_mode(gravity_mode), sandbox(sandbox)
 {
     LOG_DEBUG_WRITE("World::World", "World object created");
 
-    font_asset = AAssetManager_open(asset_manager, "DejaVuSansMono_ascii.ttf", AASSET_MODE_STREAMING);
+    if(sandbox.enabled)
+    {
+        win_size = std::max(sandbox.arena_size, default_win_size);
+        pressure_map = Pressure_map(win_size);
+        LOG_DEBUG_PRINT("World::World", "sandbox mode: %.0f arena, %.0f balls / s, %zu max balls", win_size, sandbox.spawn_rate, sandbox.max_balls);
+    }
+
+    label_atlas_asset = AAssetManager_open(asset_manager, "digits.sdf", AASSET_MODE_STREAMING);
     vert_shader_asset = AAssetManager_open(asset_manager, "2050.vert", AASSET_MODE_STREAMING);
     frag_shader_asset = AAssetManager_open(asset_manager, "2050.frag", AASSET_MODE_STREAMING);
+    point_vert_shader_asset = AAssetManager_open(asset_manager, "2050_point.vert", AASSET_MODE_STREAMING);
+    point_frag_shader_asset = AAssetManager_open(asset_manager, "2050_point.frag", AASSET_MODE_STREAMING);
+    flat_vert_shader_asset = AAssetManager_open(asset_manager, "2050_flat.vert", AASSET_MODE_STREAMING);
+    flat_frag_shader_asset = AAssetManager_open(asset_manager, "2050_flat.frag", AASSET_MODE_STREAMING);
+    quad_vert_shader_asset = AAssetManager_open(asset_manager, "2050_quad.vert", AASSET_MODE_STREAMING);
+    quad_frag_shader_asset = AAssetManager_open(asset_manager, "2050_quad.frag", AASSET_MODE_STREAMING);
+    pressure_vert_shader_asset = AAssetManager_open(asset_manager, "2050_pressure.vert", AASSET_MODE_STREAMING);
+    pressure_frag_shader_asset = AAssetManager_open(asset_manager, "2050_pressure.frag", AASSET_MODE_STREAMING);
+    label_vert_shader_asset = AAssetManager_open(asset_manager, "2050_label.vert", AASSET_MODE_STREAMING);
+    label_frag_shader_asset = AAssetManager_open(asset_manager, "2050_label.frag", AASSET_MODE_STREAMING);
 
     bg_color = color_int_to_vec(get_res_color("bg_color"));
 
@@ -63,36 +87,126 @@ World::World(AAssetManager * asset_manager, bool gravity_mode) : gravity_mode(gr
        ball_colors.emplace_back(color_int_to_vec(color));
     }
 
+    // preallocate, so a warmed up game never allocates in physics_step or render.
+    // The collision grid is at its finest when every ball is the smallest size
+    reserve_balls(sandbox.enabled ? sandbox.max_balls : initial_ball_pool);
+    auto finest_grid_dim = std::min(static_cast<std::size_t>(std::ceil(win_size / std::max(2.0f * Ball::radius_for_size(1), win_size / static_cast<float>(max_grid_dim)))), max_grid_dim);
+    grid_cell_start.reserve(finest_grid_dim * finest_grid_dim + 1);
+    grid_next_slot.reserve(finest_grid_dim * finest_grid_dim + 1);
+
     new_game();
 }
 World::~World()
 {
     LOG_DEBUG_WRITE("World::~World", "World object destroyed");
-    AAsset_close(font_asset);
+    AAsset_close(label_atlas_asset);
     AAsset_close(vert_shader_asset);
     AAsset_close(frag_shader_asset);
+    AAsset_close(point_vert_shader_asset);
+    AAsset_close(point_frag_shader_asset);
+    AAsset_close(flat_vert_shader_asset);
+    AAsset_close(flat_frag_shader_asset);
+    AAsset_close(quad_vert_shader_asset);
+    AAsset_close(quad_frag_shader_asset);
+    AAsset_close(pressure_vert_shader_asset);
+    AAsset_close(pressure_frag_shader_asset);
+    AAsset_close(label_vert_shader_asset);
+    AAsset_close(label_frag_shader_asset);
 }
 
-void World::init()
+void World::init(bool gles3, const std::string & shader_cache_dir)
 {
     LOG_DEBUG_WRITE("World::init", "initializing opengl objects");
 
-    std::string_view ball_vertshader{static_cast<const char *>(AAsset_getBuffer(vert_shader_asset)), static_cast<std::size_t>(AAsset_getLength(vert_shader_asset))};
-    std::string_view ball_fragshader{static_cast<const char *>(AAsset_getBuffer(frag_shader_asset)), static_cast<std::size_t>(AAsset_getLength(frag_shader_asset))};
+    gl_state::init(gles3);
+    program_cache = std::make_unique<Program_cache>(shader_cache_dir, gles3);
+    gpu_timer = std::make_unique<Gpu_timer>();
 
-    ball_prog = std::make_unique<Shader_prog>(std::vector<std::pair<std::string_view, GLenum>>{{ball_vertshader, GL_VERTEX_SHADER}, {ball_fragshader, GL_FRAGMENT_SHADER}},
-                                              std::vector<std::string>{"vert_pos", "ball_pos", "radius", "vert_color"});
-    ball_vbo = std::make_unique<GL_buffer>(GL_ARRAY_BUFFER);
-    ball_vbo->bind();
-    glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(std::size(ball_data) *
-                                                          sizeof(decltype(ball_data)::value_type)), nullptr, GL_DYNAMIC_DRAW);
+    instanced = gles3;
+    if(instanced)
+        LOG_DEBUG_WRITE("World::init", "using instanced rendering");
 
-    // font sizes don't matter yet b/c resize should be called immediately after init
-    font = std::make_unique<textogl::Font_sys>((unsigned char *)AAsset_getBuffer(font_asset), AAsset_getLength(font_asset), 0);
+    init_ball_shape(Ball_shape::TRIANGLE, vert_shader_asset, frag_shader_asset);
+    init_ball_shape(Ball_shape::QUAD, quad_vert_shader_asset, quad_frag_shader_asset);
+    ball_stream = std::make_unique<Streaming_buffer>(GL_ARRAY_BUFFER, std::size(ball_data), gles3);
+
+    if(!instanced)
+    {
+        // GL ES 2 can still save some vertex traffic by drawing small enough balls as point sprites
+        std::string_view point_vertshader{static_cast<const char *>(AAsset_getBuffer(point_vert_shader_asset)), static_cast<std::size_t>(AAsset_getLength(point_vert_shader_asset))};
+        std::string_view point_fragshader{static_cast<const char *>(AAsset_getBuffer(point_frag_shader_asset)), static_cast<std::size_t>(AAsset_getLength(point_frag_shader_asset))};
+
+        point_prog = std::make_unique<Shader_prog>(std::vector<std::pair<std::string_view, GLenum>>{{point_vertshader, GL_VERTEX_SHADER}, {point_fragshader, GL_FRAGMENT_SHADER}},
+                                                   std::vector<std::string>{"ball_pos", "size"}, program_cache.get());
+        point_uniforms.projection = point_prog->get_uniform<glm::mat3>("projection");
+        point_uniforms.screen_size = point_prog->get_uniform<glm::vec2>("screen_size");
+        point_uniforms.win_size = point_prog->get_uniform<GLfloat>("win_size");
+        point_uniforms.palette = point_prog->get_uniform<glm::vec4>("palette[0]");
+        upload_palette(*point_prog, point_uniforms.palette);
+
+        GLfloat point_size_range[2] = {1.0f, 1.0f};
+        glGetFloatv(GL_ALIASED_POINT_SIZE_RANGE, point_size_range);
+        max_point_size = point_size_range[1];
+        LOG_DEBUG_PRINT("World::init", "max point size: %f", max_point_size);
+    }
+
+    std::string_view flat_vertshader{static_cast<const char *>(AAsset_getBuffer(flat_vert_shader_asset)), static_cast<std::size_t>(AAsset_getLength(flat_vert_shader_asset))};
+    std::string_view flat_fragshader{static_cast<const char *>(AAsset_getBuffer(flat_frag_shader_asset)), static_cast<std::size_t>(AAsset_getLength(flat_frag_shader_asset))};
+    flat_prog = std::make_unique<Shader_prog>(std::vector<std::pair<std::string_view, GLenum>>{{flat_vertshader, GL_VERTEX_SHADER}, {flat_fragshader, GL_FRAGMENT_SHADER}},
+                                              std::vector<std::string>{"ball_pos", "size"}, program_cache.get());
+    flat_uniforms.projection = flat_prog->get_uniform<glm::mat3>("projection");
+    flat_uniforms.screen_size = flat_prog->get_uniform<glm::vec2>("screen_size");
+    flat_uniforms.win_size = flat_prog->get_uniform<GLfloat>("win_size");
+    flat_uniforms.palette = flat_prog->get_uniform<glm::vec4>("palette[0]");
+    upload_palette(*flat_prog, flat_uniforms.palette);
+
+    std::string_view pressure_vertshader{static_cast<const char *>(AAsset_getBuffer(pressure_vert_shader_asset)), static_cast<std::size_t>(AAsset_getLength(pressure_vert_shader_asset))};
+    std::string_view pressure_fragshader{static_cast<const char *>(AAsset_getBuffer(pressure_frag_shader_asset)), static_cast<std::size_t>(AAsset_getLength(pressure_frag_shader_asset))};
+    pressure_map.init(pressure_vertshader, pressure_fragshader, program_cache.get());
+
+    // text size doesn't matter yet b/c resize should be called immediately after init
+    std::string_view label_vertshader{static_cast<const char *>(AAsset_getBuffer(label_vert_shader_asset)), static_cast<std::size_t>(AAsset_getLength(label_vert_shader_asset))};
+    std::string_view label_fragshader{static_cast<const char *>(AAsset_getBuffer(label_frag_shader_asset)), static_cast<std::size_t>(AAsset_getLength(label_frag_shader_asset))};
+    labels = std::make_unique<Label_batch>(static_cast<const unsigned char *>(AAsset_getBuffer(label_atlas_asset)), static_cast<std::size_t>(AAsset_getLength(label_atlas_asset)),
+                                           label_vertshader, label_fragshader, gles3, program_cache.get());
+
+    auto & cache_stats = program_cache->get_stats();
+    LOG_DEBUG_PRINT("World::init", "shader programs: %u loaded from cache in %.3f ms, %u compiled in %.3f ms",
+                    cache_stats.hits, 1000.0f * cache_stats.load_time.count(), cache_stats.misses, 1000.0f * cache_stats.compile_time.count());
 
     glClearColor(bg_color.r, bg_color.g, bg_color.b, bg_color.a);
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    dirty = true;
+}
+
+void World::init_ball_shape(Ball_shape shape, AAsset * vert_asset, AAsset * frag_asset)
+{
+    auto & shape_data = ball_shapes[static_cast<std::size_t>(shape)];
+
+    std::string_view vertshader{static_cast<const char *>(AAsset_getBuffer(vert_asset)), static_cast<std::size_t>(AAsset_getLength(vert_asset))};
+    std::string_view fragshader{static_cast<const char *>(AAsset_getBuffer(frag_asset)), static_cast<std::size_t>(AAsset_getLength(frag_asset))};
+
+    shape_data.prog = std::make_unique<Shader_prog>(std::vector<std::pair<std::string_view, GLenum>>{{vertshader, GL_VERTEX_SHADER}, {fragshader, GL_FRAGMENT_SHADER}},
+                                                    std::vector<std::string>{"ball_pos", "size", "corner"}, program_cache.get());
+    shape_data.uniforms.projection = shape_data.prog->get_uniform<glm::mat3>("projection");
+    // only the triangle shape reconstructs local coordinates from the fragment position
+    shape_data.uniforms.inv_projection = shape_data.prog->get_uniform_optional<glm::mat3>("inv_projection");
+    shape_data.uniforms.screen_size = shape_data.prog->get_uniform_optional<glm::vec2>("screen_size");
+    shape_data.uniforms.win_size = shape_data.prog->get_uniform<GLfloat>("win_size");
+    shape_data.uniforms.palette = shape_data.prog->get_uniform<glm::vec4>("palette[0]");
+    upload_palette(*shape_data.prog, shape_data.uniforms.palette);
+
+    if(instanced)
+    {
+        shape_data.corner_vbo = std::make_unique<GL_buffer>(GL_ARRAY_BUFFER);
+        shape_data.corner_vbo->bind();
+        std::vector<std::uint8_t> corner_data(std::size(shape_data.corners) * Ball_corner::stride);
+        for(std::size_t i = 0; i < std::size(shape_data.corners); ++i)
+            Ball_corner::pack(&corner_data[i * Ball_corner::stride], {shape_data.corners[i]});
+        glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(std::size(corner_data)), std::data(corner_data), GL_STATIC_DRAW);
+    }
 }
 
 void World::pause()
@@ -101,6 +215,8 @@ void World::pause()
     paused = true;
 }
 bool World::is_paused() const { return paused; }
+// nothing will move until unpaused or a new game is started
+bool World::is_idle() const { return paused || state == State::LOSE; }
 void World::unpause()
 {
     LOG_DEBUG_WRITE("World::unpause", "unpaused");
@@ -110,11 +226,24 @@ void World::unpause()
 void World::destroy()
 {
     LOG_DEBUG_WRITE("World::destroy", "destroying opengl objects");
-    ball_prog.reset();
-    ball_vbo.reset();
-
-    ball_texts.clear();
-    font.reset();
+    for(auto & pass_vaos: ball_vaos)
+    {
+        for(auto & vaos: pass_vaos)
+            vaos.clear();
+    }
+    for(auto & shape: ball_shapes)
+    {
+        shape.prog.reset();
+        shape.corner_vbo.reset();
+    }
+    ball_stream.reset();
+    point_prog.reset();
+    flat_prog.reset();
+    pressure_map.destroy();
+    program_cache.reset();
+
+    labels.reset();
+    gpu_timer.reset();
 }
 
 void World::resize(GLsizei width, GLsizei height)
@@ -138,162 +267,576 @@ void World::resize(GLsizei width, GLsizei height)
     }
 
     projection = ortho3x3(left, right, bottom, top);
+    dirty = true;
 
-    auto scale_factor = std::min(screen_size.x, screen_size.y) / win_size;
-    auto new_text_size = static_cast<int>(scale_factor * initial_text_size);
-    LOG_DEBUG_PRINT("World::resize", "font resized from %d to %d", text_size, new_text_size);
+    auto scale_factor = get_pixel_scale();
+    auto new_text_size = std::max(static_cast<int>(scale_factor * initial_text_size), 1);
+    LOG_DEBUG_PRINT("World::resize", "text resized from %d to %d", text_size, new_text_size);
     text_size = new_text_size;
-    font->resize(static_cast<unsigned int>(text_size));
-    for(auto & t: ball_texts)
-        t.set_font_sys(*font);
+    labels->resize(static_cast<unsigned int>(text_size));
 
     auto inv_projection = glm::inverse(projection);
 
-    ball_prog->use();
-    glUniformMatrix3fv(ball_prog->get_uniform("projection"), 1, GL_FALSE, &projection[0][0]);
-    glUniformMatrix3fv(ball_prog->get_uniform("inv_projection"), 1, GL_FALSE, &inv_projection[0][0]);
-    glUniform2fv(ball_prog->get_uniform("screen_size"), 1, &screen_size[0]);
-    glUniform1f(ball_prog->get_uniform("win_size"), win_size);
+    for(auto & shape: ball_shapes)
+    {
+        shape.prog->use();
+        shape.uniforms.projection.set(projection);
+        shape.uniforms.inv_projection.set(inv_projection);
+        shape.uniforms.screen_size.set(screen_size);
+        shape.uniforms.win_size.set(win_size);
+    }
+
+    if(point_prog)
+    {
+        point_prog->use();
+        point_uniforms.projection.set(projection);
+        point_uniforms.screen_size.set(screen_size);
+        point_uniforms.win_size.set(win_size);
+    }
+
+    flat_prog->use();
+    flat_uniforms.projection.set(projection);
+    flat_uniforms.screen_size.set(screen_size);
+    flat_uniforms.win_size.set(win_size);
+
+    pressure_map.resize(projection);
+
+    update_lods();
 
     GL_CHECK_ERROR("World::resize");
 }
 
-void World::render_balls()
+void World::update_lods()
 {
-    // triangle to render balls onto
-    const std::vector<glm::vec2> verts =
+    auto tier = [](float radius)
     {
-        {-0.5f * std::sqrt(3.0f), -0.5f},
-        { 0.0f,                    1.0f},
-        { 0.5f * std::sqrt(3.0f), -0.5f}
+        return (radius < flat_lod_radius) ? Ball_lod::FLAT : (radius < label_lod_radius) ? Ball_lod::NO_LABEL : Ball_lod::FULL;
     };
 
-    // load up a buffer with vertex data. unfortunately GL ES 2.0 is pretty limited, so lots of duplication here
-    // if we had instanced rendering or geometry shaders, this would be much easier
-    auto data_size = std::size(balls) * std::size(verts) * num_ball_attrs;
-    auto old_ball_data_size = std::size(ball_data);
+    auto scale = get_pixel_scale();
+    for(int size = 0; size < palette_size; ++size)
+    {
+        if(!lod_enabled)
+        {
+            size_lods[size] = Ball_lod::FULL;
+            continue;
+        }
 
+        // keep the current tier unless the radius is clearly inside another one
+        auto radius = Ball::radius_for_size(size) * scale;
+        size_lods[size] = std::clamp(size_lods[size], tier(radius * (1.0f + lod_hysteresis)), tier(radius * (1.0f - lod_hysteresis)));
+    }
+    dirty = true;
+}
+
+void World::count_lods()
+{
+    lod_counts = {};
+    for(auto & ball: balls)
+        ++lod_counts[static_cast<std::size_t>(get_lod(ball))];
+}
+
+void World::set_lod_enabled(bool enabled)
+{
+    lod_enabled = enabled;
+    update_lods();
+}
+
+void World::set_ball_shape(Ball_shape shape)
+{
+    ball_shape = shape;
+    dirty = true;
+}
+
+void World::set_pressure_overlay(bool enabled)
+{
+    pressure_overlay = enabled;
+    pressure_map.clear();
+    dirty = true;
+}
+
+float World::text_angle() const
+{
+    if(!gravity_mode)
+        return 0.0f;
+
+    // rotate text to be upright as the device is rotated
+    float grav_angle = std::atan2(-grav_vec.x, grav_vec.y);
+
+    // snap to nearest pi / 2
+    if(grav_angle < -0.75f * pi)
+        return -pi;
+    else if(grav_angle < -0.25f * pi)
+        return -0.5f * pi;
+    else if(grav_angle < 0.25f * pi)
+        return 0.0f;
+    else if(grav_angle < 0.75f * pi)
+        return 0.5f * pi;
+    else
+        return pi;
+}
+
+std::array<GLushort, 2> World::pack_pos(const glm::vec2 & pos) const
+{
+    auto normalized = glm::clamp(pos / win_size, 0.0f, 1.0f);
+    return {static_cast<GLushort>(std::lround(normalized.x * 65535.0f)), static_cast<GLushort>(std::lround(normalized.y * 65535.0f))};
+}
+std::array<GLubyte, 1> World::pack_size(int size)
+{
+    return {static_cast<GLubyte>(std::clamp(size, 0, palette_size - 1))};
+}
+
+void World::upload_palette(const Shader_prog & prog, const Uniform<glm::vec4> & palette_uniform)
+{
+    std::array<glm::vec4, palette_size> palette;
+    for(int size = 0; size < palette_size; ++size)
+    {
+        auto color = ball_colors[ball_color_index(std::max(size, 1), static_cast<int>(std::size(ball_colors)))];
+        palette[size] = {color.r, color.g, color.b, Ball::radius_for_size(size)};
+    }
+
+    prog.use();
+    palette_uniform.set(std::data(palette), palette_size);
+}
+
+// make sure ball_data can hold data_size bytes
+void World::grow_ball_data(std::size_t data_size)
+{
     while(std::size(ball_data) < data_size)
         ball_data.resize(2 * std::size(ball_data));
+}
 
-    auto ball = std::begin(balls);
-    for(std::size_t ball_i = 0; ball_i < std::size(balls); ++ball_i)
-    {
-        const auto & pos = ball->get_pos();
-        const auto & color = ball->get_color();
+std::size_t World::render_balls()
+{
+    // load up a buffer with vertex data. unfortunately GL ES 2.0 is pretty limited, so lots of duplication here
+    // if we have GL ES 3.0, render_balls_instanced avoids this
+    auto & shape = get_ball_shape();
+    auto num_balls = std::size(balls) - lod_counts[static_cast<std::size_t>(Ball_lod::FLAT)];
+    auto data_size = num_balls * std::size(shape.corners) * Ball_vertex::stride;
+    grow_ball_data(data_size);
 
-        for(std::size_t vert_i = 0; vert_i < std::size(verts); ++vert_i)
+    {
+        TRACE_SCOPE("pack balls");
+        std::size_t data_i = 0;
+        for(auto & ball: balls)
         {
-            std::size_t data_i = (ball_i * std::size(verts) + vert_i) * num_ball_attrs;
-            ball_data[data_i + 0] = verts[vert_i].x;
-            ball_data[data_i + 1] = verts[vert_i].y;
-            ball_data[data_i + 2] = pos.x;
-            ball_data[data_i + 3] = pos.y;
-            ball_data[data_i + 4] = ball->get_radius();
-            ball_data[data_i + 5] = color.r;
-            ball_data[data_i + 6] = color.g;
-            ball_data[data_i + 7] = color.b;
+            if(get_lod(ball) == Ball_lod::FLAT)
+                continue;
+
+            auto pos = pack_pos(ball.get_pos());
+            auto size = pack_size(ball.get_size());
+
+            for(auto corner: shape.corners)
+            {
+                Ball_vertex::pack(&ball_data[data_i], pos, size, {corner});
+                data_i += Ball_vertex::stride;
+            }
         }
+    }
+
+    shape.prog->use();
+    auto offset = ball_stream->upload(std::data(ball_data), data_size);
+
+    if(bind_ball_vao(Ball_pass::TRIANGLES, offset))
+        Ball_vertex::enable(0, offset);
+
+    glDrawArrays(GL_TRIANGLES, 0, static_cast<GLint>(num_balls * std::size(shape.corners)));
+
+    // leave the default VAO bound for the labels
+    if(gl_state::has_vertex_arrays())
+        gl_state::bind_vertex_array(0);
+    else
+        Ball_vertex::disable();
+    ball_stream->fence();
+
+    return data_size;
+}
+
+// returns the offset into ball_stream the data was written to
+GLintptr World::upload_ball_instances(bool flat)
+{
+    // one copy of each ball's data: position and size
+    auto num_flat = lod_counts[static_cast<std::size_t>(Ball_lod::FLAT)];
+    auto data_size = (flat ? num_flat : std::size(balls) - num_flat) * Ball_instance::stride;
+    grow_ball_data(data_size);
 
-        ++ball;
+    {
+        TRACE_SCOPE("pack balls");
+        std::size_t data_i = 0;
+        for(auto & ball: balls)
+        {
+            if((get_lod(ball) == Ball_lod::FLAT) != flat)
+                continue;
+
+            Ball_instance::pack(&ball_data[data_i], pack_pos(ball.get_pos()), pack_size(ball.get_size()));
+            data_i += Ball_instance::stride;
+        }
     }
 
-    ball_prog->use();
-    ball_vbo->bind();
+    return ball_stream->upload(std::data(ball_data), data_size);
+}
 
-    if(std::size(ball_data) > old_ball_data_size)
+std::size_t World::render_balls_instanced()
+{
+    auto & shape = get_ball_shape();
+    shape.prog->use();
+
+    // GL ES 3 always has VAOs, so divisors stay in the VAO and don't need to be reset for the labels
+    auto num_balls = std::size(balls) - lod_counts[static_cast<std::size_t>(Ball_lod::FLAT)];
+    auto offset = upload_ball_instances(false);
+    if(bind_ball_vao(Ball_pass::INSTANCED, offset))
     {
-        LOG_DEBUG_PRINT("World::render_balls", "ball_data buffer resized from %d to %d", static_cast<int>(old_ball_data_size), static_cast<int>(std::size(ball_data)));
-        glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(std::size(ball_data) *
-                                                              sizeof(decltype(ball_data)::value_type)), std::data(ball_data), GL_DYNAMIC_DRAW);
+        Ball_instance::enable(0, offset);
+        Ball_instance::set_divisor(1, 0);
+
+        shape.corner_vbo->bind();
+        Ball_corner::enable(2);
     }
+
+    glDrawArraysInstanced(GL_TRIANGLES, 0, static_cast<GLsizei>(std::size(shape.corners)), static_cast<GLsizei>(num_balls));
+
+    gl_state::bind_vertex_array(0);
+    ball_stream->fence();
+
+    return num_balls * Ball_instance::stride;
+}
+
+std::size_t World::render_balls_points()
+{
+    point_prog->use();
+
+    auto num_balls = std::size(balls) - lod_counts[static_cast<std::size_t>(Ball_lod::FLAT)];
+    auto offset = upload_ball_instances(false);
+
+    if(bind_ball_vao(Ball_pass::POINTS, offset))
+        Ball_instance::enable(0, offset);
+
+    glDrawArrays(GL_POINTS, 0, static_cast<GLsizei>(num_balls));
+
+    if(gl_state::has_vertex_arrays())
+        gl_state::bind_vertex_array(0);
+    else
+        Ball_instance::disable();
+    ball_stream->fence();
+
+    return num_balls * Ball_instance::stride;
+}
+
+std::size_t World::render_balls_flat()
+{
+    flat_prog->use();
+
+    auto num_balls = lod_counts[static_cast<std::size_t>(Ball_lod::FLAT)];
+    auto offset = upload_ball_instances(true);
+
+    if(bind_ball_vao(Ball_pass::FLAT, offset))
+        Ball_instance::enable(0, offset);
+
+    glDrawArrays(GL_POINTS, 0, static_cast<GLsizei>(num_balls));
+
+    if(gl_state::has_vertex_arrays())
+        gl_state::bind_vertex_array(0);
     else
+        Ball_instance::disable();
+    ball_stream->fence();
+
+    return num_balls * Ball_instance::stride;
+}
+
+std::size_t World::render_ball_pass(Ball_pass pass)
+{
+    switch(pass)
     {
-        glBufferSubData(GL_ARRAY_BUFFER, 0, static_cast<GLsizeiptr>(data_size *
-                                                                    sizeof(decltype(ball_data)::value_type)), std::data(ball_data));
+    case Ball_pass::TRIANGLES:
+        return render_balls();
+    case Ball_pass::INSTANCED:
+        return render_balls_instanced();
+    case Ball_pass::POINTS:
+        return render_balls_points();
+    case Ball_pass::FLAT:
+        return render_balls_flat();
     }
+    return 0;
+}
 
-    glEnableVertexAttribArray(0);
-    glEnableVertexAttribArray(1);
-    glEnableVertexAttribArray(2);
-    glEnableVertexAttribArray(3);
+// bind the VAO for this pass, the current ball shape, and ball_stream's current region.
+// returns true if the vertex attributes need to be specified, which is always the case without VAO support
+bool World::bind_ball_vao(Ball_pass pass, GLintptr offset)
+{
+    if(!gl_state::has_vertex_arrays())
+        return true;
 
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, static_cast<GLsizei>(num_ball_attrs * sizeof(decltype(ball_data)::value_type)), reinterpret_cast<GLvoid *>(0 * sizeof(decltype(ball_data)::value_type)));
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, static_cast<GLsizei>(num_ball_attrs * sizeof(decltype(ball_data)::value_type)), reinterpret_cast<GLvoid *>(2 * sizeof(decltype(ball_data)::value_type)));
-    glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, static_cast<GLsizei>(num_ball_attrs * sizeof(decltype(ball_data)::value_type)), reinterpret_cast<GLvoid *>(4 * sizeof(decltype(ball_data)::value_type)));
-    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, static_cast<GLsizei>(num_ball_attrs * sizeof(decltype(ball_data)::value_type)), reinterpret_cast<GLvoid *>(5 * sizeof(decltype(ball_data)::value_type)));
+    auto & vaos = ball_vaos[static_cast<std::size_t>(pass)][static_cast<std::size_t>(ball_shape)];
+    auto region = ball_stream->get_current_region();
+    while(std::size(vaos) <= region)
+        vaos.emplace_back();
 
-    glDrawArrays(GL_TRIANGLES, 0, static_cast<GLint>(std::size(balls) * std::size(verts)));
+    auto & vao = vaos[region];
+    vao.vao.bind();
+    if(vao.offset == offset)
+        return false;
 
-    glDisableVertexAttribArray(0);
-    glDisableVertexAttribArray(1);
-    glDisableVertexAttribArray(2);
-    glDisableVertexAttribArray(3);
+    vao.offset = offset;
+    return true;
 }
 
-bool World::render()
+World::Ball_pass World::choose_ball_pass() const
 {
-    glClear(GL_COLOR_BUFFER_BIT);
+    if(instanced)
+        return Ball_pass::INSTANCED;
+
+    if(!point_prog)
+        return Ball_pass::TRIANGLES;
+
+    // point sprites can't be bigger than GL_ALIASED_POINT_SIZE_RANGE allows
+    float max_radius = 0.0f;
+    for(auto & ball: balls)
+    {
+        if(get_lod(ball) != Ball_lod::FLAT)
+            max_radius = std::max(max_radius, ball.get_radius());
+    }
 
-    render_balls();
+    auto max_diameter_px = 2.0f * max_radius * get_pixel_scale();
+    return (max_diameter_px <= max_point_size) ? Ball_pass::POINTS : Ball_pass::TRIANGLES;
+}
 
-    float grav_angle = 0.0f;
+void World::log_render_stats() const
+{
+    unsigned long frames = 0; // the flat pass is drawn along with one of the others, so it doesn't count
+    for(std::size_t i = 0; i < std::size(ball_pass_stats); ++i)
+    {
+        if(static_cast<Ball_pass>(i) != Ball_pass::FLAT)
+            frames += ball_pass_stats[i].frames;
+    }
 
-    if(gravity_mode)
+    if(frames > 0)
     {
-        // rotate text to be upright as the device is rotated
-        grav_angle = std::atan2(-grav_vec.x, grav_vec.y);
+        LOG_DEBUG_PRINT("World::log_render_stats", "ball shape: %s", ball_shapes[static_cast<std::size_t>(ball_shape)].name);
 
-        // snap to nearest pi / 2
-        if(grav_angle < -0.75f * pi)
-            grav_angle = -pi;
-        else if(grav_angle < -0.25f * pi)
-            grav_angle = -0.5f * pi;
-        else if(grav_angle < 0.25f * pi)
-            grav_angle = 0.0f;
-        else if(grav_angle < 0.75f * pi)
-            grav_angle = 0.5f * pi;
-        else
-            grav_angle = pi;
+        auto & state_stats = gl_state::get_stats();
+        LOG_DEBUG_PRINT("World::log_render_stats", "GL state calls: %.1f / frame made, %.1f / frame skipped",
+                        static_cast<float>(state_stats.calls) / static_cast<float>(frames), static_cast<float>(state_stats.skipped) / static_cast<float>(frames));
     }
 
-    for(auto & ball: balls)
+    if(ball_stream)
     {
-        while(ball.get_size() >= static_cast<std::size_t>(std::size(ball_texts)))
-            ball_texts.emplace_back(*font, std::to_string(1u << std::size(ball_texts)));
+        auto & stream_stats = ball_stream->get_stats();
+        LOG_DEBUG_PRINT("World::log_render_stats", "ball_stream: %lu uploads, %llu bytes, %lu stalls, %lu reallocations",
+                        stream_stats.uploads, stream_stats.bytes_uploaded, stream_stats.stalls, stream_stats.reallocations);
+    }
 
-        ball_texts[ball.get_size()].render_text_rotate(ball.get_text_color(), screen_size,
-                                                       text_coord_transform(ball.get_pos()),
-                                                       grav_angle,
-                                                       textogl::ORIGIN_HORIZ_CENTER | textogl::ORIGIN_VERT_CENTER);
+    if(labels && frames > 0)
+    {
+        auto & stream_stats = labels->get_stream_stats();
+        LOG_DEBUG_PRINT("World::log_render_stats", "labels: 1 draw / frame, %.0f bytes / frame uploaded, %lu stalls",
+                        static_cast<float>(label_bytes) / static_cast<float>(frames), stream_stats.stalls);
     }
 
-    GL_CHECK_ERROR("World::render");
+    for(auto & stats: ball_pass_stats)
+    {
+        if(stats.frames == 0)
+            continue;
+
+        LOG_DEBUG_PRINT("World::log_render_stats", "%s: %lu frames, %.0f bytes / frame uploaded, %.3f ms / frame",
+                        stats.name, stats.frames, static_cast<float>(stats.bytes) / static_cast<float>(stats.frames),
+                        1000.0f * stats.time.count() / static_cast<float>(stats.frames));
+    }
+
+    auto & pressure_stats = pressure_map.get_stats();
+    if(pressure_stats.frames > 0)
+    {
+        LOG_DEBUG_PRINT("World::log_render_stats", "pressure overlay: %lu frames, %lu uploads, %.1f rows / upload, %.0f bytes / frame uploaded",
+                        pressure_stats.frames, pressure_stats.uploads,
+                        static_cast<float>(pressure_stats.rows_uploaded) / static_cast<float>(std::max(pressure_stats.uploads, 1ul)),
+                        static_cast<float>(pressure_stats.bytes_uploaded) / static_cast<float>(pressure_stats.frames));
+    }
 
-    return !paused;
+    LOG_DEBUG_PRINT("World::log_render_stats", "LOD tiers in the last frame: %zu full, %zu unlabelled, %zu flat",
+                    lod_counts[static_cast<std::size_t>(Ball_lod::FULL)], lod_counts[static_cast<std::size_t>(Ball_lod::NO_LABEL)],
+                    lod_counts[static_cast<std::size_t>(Ball_lod::FLAT)]);
+
+    if(gpu_timer && gpu_timer->is_supported())
+    {
+        auto & gpu_stats = gpu_timer->get_stats();
+        LOG_DEBUG_PRINT("World::log_render_stats", "GPU timing: %lu frames timed, %lu skipped (results pending), %lu disjoint",
+                        gpu_stats.frames_timed, gpu_stats.frames_skipped, gpu_stats.frames_disjoint);
+
+        for(std::size_t i = 0; i < Gpu_timer::num_passes; ++i)
+        {
+            auto & hist = gpu_stats.passes[i];
+            if(hist.get_count() == 0)
+                continue;
+
+            LOG_DEBUG_PRINT("World::log_render_stats", "GPU %s: mean %.3f ms, p50 < %.3f ms, p95 < %.3f ms, max %.3f ms",
+                            Gpu_timer::pass_names[i], hist.mean_ms(), hist.percentile_ms(0.5f), hist.percentile_ms(0.95f), hist.max_ms());
+        }
+    }
 }
 
-void World::physics_step(float dt, const glm::vec2 & grav_sensor_vec)
+bool World::needs_render() const
 {
-    if(paused || state == State::LOSE)
-        return;
+    float scale = get_pixel_scale();
+    return dirty || max_motion * scale >= motion_threshold || text_angle() != drawn_text_angle || (pressure_overlay && pressure_map.needs_render());
+}
 
-    if(gravity_mode)
+void World::render()
+{
+    TRACE_SCOPE("World::render");
+    gpu_timer->begin_frame();
+
+    gpu_timer->begin(Gpu_timer::Pass::CLEAR);
+    glClear(GL_COLOR_BUFFER_BIT);
+    gpu_timer->end(Gpu_timer::Pass::CLEAR);
+
+    count_lods();
+
+    // shaded balls with whichever pass suits them, then flat ones on top. With no balls there's nothing to upload, and
+    // some drivers reject mapping or uploading an empty range
+    gpu_timer->begin(Gpu_timer::Pass::BALLS);
+    if(!std::empty(balls))
     {
-        grav_vec = g * glm::normalize(grav_sensor_vec);
+        for(auto pass: {choose_ball_pass(), Ball_pass::FLAT})
+        {
+            auto num_flat = lod_counts[static_cast<std::size_t>(Ball_lod::FLAT)];
+            if((pass == Ball_pass::FLAT) ? num_flat == 0 : num_flat == std::size(balls))
+                continue;
+
+            auto & stats = ball_pass_stats[static_cast<std::size_t>(pass)];
+            auto ball_pass_start = std::chrono::steady_clock::now();
+            stats.bytes += render_ball_pass(pass);
+            stats.time += std::chrono::steady_clock::now() - ball_pass_start;
+            ++stats.frames;
+        }
+    }
+    gpu_timer->end(Gpu_timer::Pass::BALLS);
 
-        float grav_angle = std::atan2(grav_vec.x, -grav_vec.y);
-        auto diff = std::abs(grav_angle - grav_ref_angle);
-        if(diff > pi)
-            diff = 2.0f * pi - diff;
+    // over the balls, but under the labels so they stay readable
+    if(pressure_overlay)
+    {
+        TRACE_SCOPE("pressure overlay");
+        gpu_timer->begin(Gpu_timer::Pass::PRESSURE);
+        pressure_map.draw();
+        gpu_timer->end(Gpu_timer::Pass::PRESSURE);
+    }
 
-        if(diff > pi / 4.0f)
+    float grav_angle = text_angle();
+
+    if(text_size >= min_text_size && lod_counts[static_cast<std::size_t>(Ball_lod::FULL)] > 0)
+    {
+        TRACE_SCOPE("labels");
+        for(auto & ball: balls)
         {
-            grav_ref_angle = grav_angle;
-            balls.emplace_back(win_size, ball_colors);
+            if(get_lod(ball) == Ball_lod::FULL)
+                labels->add(ball.get_size(), text_coord_transform(ball.get_pos()), ball.get_text_color());
         }
+        gpu_timer->begin(Gpu_timer::Pass::LABELS);
+        label_bytes += labels->draw(screen_size, grav_angle);
+        gpu_timer->end(Gpu_timer::Pass::LABELS);
     }
 
+    for(auto & ball: balls)
+        ball.mark_drawn();
+
+    gpu_timer->end_frame();
+
+    dirty = false;
+    max_motion = 0.0f;
+    drawn_text_angle = grav_angle;
+
+    GL_CHECK_ERROR("World::render");
+}
+
+template<typename... Args>
+void World::add_ball(Args &&... args)
+{
+    if(std::empty(free_balls))
+        free_balls.emplace_back(std::forward<Args>(args)...);
+    else
+        free_balls.front() = Ball(std::forward<Args>(args)...);
+
+    balls.splice(std::end(balls), free_balls, std::begin(free_balls));
+}
+
+void World::remove_ball(std::list<Ball>::iterator ball)
+{
+    free_balls.splice(std::begin(free_balls), balls, ball);
+}
+
+void World::remove_all_balls()
+{
+    free_balls.splice(std::begin(free_balls), balls);
+}
+
+void World::reserve_balls(std::size_t count)
+{
+    while(std::size(balls) + std::size(free_balls) < count)
+        free_balls.emplace_back(win_size, ball_colors);
+    grid_cells.reserve(count);
+    grid_entries.reserve(count);
+
+    std::size_t max_corners = 0;
+    for(auto & shape: ball_shapes)
+        max_corners = std::max(max_corners, std::size(shape.corners));
+    grow_ball_data(count * max_corners * Ball_vertex::stride);
+}
+
+// counting sort balls into grid_entries by cell. Returns the grid's width and height, in cells
+std::size_t World::sort_into_grid()
+{
+    TRACE_SCOPE("broadphase");
+
+    // cells must be at least as wide as the biggest ball, so any two touching balls are in the same or adjacent cells
+    float max_radius = 0.0f;
+    for(auto & ball: balls)
+        max_radius = std::max(max_radius, ball.get_radius());
+
+    auto cell_size = std::max(2.0f * max_radius, win_size / static_cast<float>(max_grid_dim));
+    auto grid_dim = std::clamp(static_cast<std::size_t>(std::ceil(win_size / cell_size)), std::size_t{1}, max_grid_dim);
+
+    auto cell_coord = [grid_dim, cell_size](float x)
+    {
+        return std::min(static_cast<std::size_t>(std::max(x, 0.0f) / cell_size), grid_dim - 1);
+    };
+
+    grid_cells.clear();
+    grid_cell_start.assign(grid_dim * grid_dim + 1, 0);
+    for(auto & ball: balls)
+    {
+        auto pos = ball.get_pos();
+        auto cell = static_cast<std::uint32_t>(cell_coord(pos.y) * grid_dim + cell_coord(pos.x));
+        grid_cells.push_back(cell);
+        ++grid_cell_start[cell + 1];
+    }
+    for(std::size_t i = 1; i < std::size(grid_cell_start); ++i)
+        grid_cell_start[i] += grid_cell_start[i - 1];
+
+    grid_entries.resize(std::size(balls));
+    grid_next_slot.assign(std::begin(grid_cell_start), std::end(grid_cell_start));
+    {
+        std::size_t i = 0;
+        for(auto ball = std::begin(balls); ball != std::end(balls); ++ball, ++i)
+            grid_entries[grid_next_slot[grid_cells[i]]++] = {ball, false};
+    }
+
+    return grid_dim;
+}
+
+void World::add_contact_pressure(const Ball & a, const Ball & b, float compression)
+{
+    if(!pressure_overlay)
+        return;
+
+    // at the contact point
+    auto pos_a = a.get_pos(), pos_b = b.get_pos();
+    auto ra = a.get_radius(), rb = b.get_radius();
+    pressure_map.add(pos_b + (pos_a - pos_b) * (rb / (ra + rb)), compression);
+}
+
+// move each ball, then resolve collisions between it and every ball after it, merging equal sizes. Merges happen as
+// they're found, so the earlier ball in the list is the one that survives. This is how the normal game has always
+// played, so it's kept there. Returns the total compression
+float World::move_and_collide(float dt)
+{
     float compression = 0.0f;
     for(auto ball = std::begin(balls); ball != std::end(balls); ++ball)
     {
@@ -306,39 +849,177 @@ void World::physics_step(float dt, const glm::vec2 & grav_sensor_vec)
 
         ball->physics_step(dt, win_size, grav_vec, wall_damp);
 
-        // check for collision
-        for(auto other = std::next(ball); other != std::end(balls); ++other)
+        for(auto other = std::next(ball); other != std::end(balls);)
         {
             auto collision = collide_balls(*ball, *other, e);
+            if(collision.merged)
+            {
+                remove_ball(other++);
+                dirty = true;
+                ball_merged(*ball);
+                continue;
+            }
 
             if(collision.collided)
             {
-                if(collision.merged)
-                {
-                    other = std::prev(balls.erase(other));
-                    score += 1u << static_cast<unsigned int>(ball->get_size());
-                    high_score = std::max(high_score, score);
-                    if(ball->get_size() >= next_achievement_size)
-                    {
-                        achievement(next_achievement_size);
-                        ++next_achievement_size;
-                    }
-                } else
+                compression += collision.compression;
+                add_contact_pressure(*ball, *other, collision.compression);
+            }
+            ++other;
+        }
+    }
+
+    return compression;
+}
+
+// resolve collisions between all balls at once through the grid, merging equal sizes. Which ball of a merging pair
+// survives depends on the grid's cell order. Returns the total compression
+float World::collide()
+{
+    TRACE_SCOPE("collide");
+
+    auto grid_dim = sort_into_grid();
+
+    float compression = 0.0f;
+    bool any_merged = false;
+    auto collide_pair = [&](Grid_entry & a, Grid_entry & b)
+    {
+        if(a.merged || b.merged)
+            return;
+
+        auto collision = collide_balls(*a.ball, *b.ball, e);
+        if(!collision.collided)
+            return;
+
+        if(!collision.merged)
+        {
+            compression += collision.compression;
+            add_contact_pressure(*a.ball, *b.ball, collision.compression);
+            return;
+        }
+
+        b.merged = any_merged = true;
+        dirty = true;
+        ball_merged(*a.ball);
+    };
+
+    // each pair of cells is visited once: a cell against itself, then its right, and three lower neighbors
+    constexpr std::array<std::pair<int, int>, 4> neighbors {{{1, 0}, {-1, 1}, {0, 1}, {1, 1}}};
+    for(std::size_t y = 0; y < grid_dim; ++y)
+    {
+        for(std::size_t x = 0; x < grid_dim; ++x)
+        {
+            auto cell = y * grid_dim + x;
+            for(auto i = grid_cell_start[cell]; i < grid_cell_start[cell + 1]; ++i)
+            {
+                for(auto j = i + 1; j < grid_cell_start[cell + 1]; ++j)
+                    collide_pair(grid_entries[i], grid_entries[j]);
+
+                for(auto [dx, dy]: neighbors)
                 {
-                    compression += collision.compression;
+                    auto nx = static_cast<std::ptrdiff_t>(x) + dx, ny = static_cast<std::ptrdiff_t>(y) + dy;
+                    if(nx < 0 || nx >= static_cast<std::ptrdiff_t>(grid_dim) || ny >= static_cast<std::ptrdiff_t>(grid_dim))
+                        continue;
+
+                    auto other_cell = static_cast<std::size_t>(ny) * grid_dim + static_cast<std::size_t>(nx);
+                    for(auto j = grid_cell_start[other_cell]; j < grid_cell_start[other_cell + 1]; ++j)
+                        collide_pair(grid_entries[i], grid_entries[j]);
                 }
             }
         }
     }
 
-    last_compressions.push_back(compression / std::size(balls));
-    last_compressions.pop_front();
+    if(any_merged)
+    {
+        TRACE_SCOPE("merge");
+        for(auto & entry: grid_entries)
+        {
+            if(entry.merged)
+                remove_ball(entry.ball);
+        }
+    }
+
+    return compression;
+}
+
+void World::ball_merged(const Ball & ball)
+{
+    if(sandbox.enabled)
+        return;
+
+    score += 1u << static_cast<unsigned int>(ball.get_size());
+    high_score = std::max(high_score, score);
+    if(ball.get_size() >= next_achievement_size)
+    {
+        achievement(next_achievement_size);
+        ++next_achievement_size;
+    }
+}
+
+void World::physics_step(float dt, const glm::vec2 & grav_sensor_vec)
+{
+    if(paused || state == State::LOSE)
+        return;
+
+    TRACE_SCOPE("World::physics_step");
+
+    if(gravity_mode)
+    {
+        grav_vec = g * glm::normalize(grav_sensor_vec);
+
+        float grav_angle = std::atan2(grav_vec.x, -grav_vec.y);
+        auto diff = std::abs(grav_angle - grav_ref_angle);
+        if(diff > pi)
+            diff = 2.0f * pi - diff;
+
+        if(diff > pi / 4.0f)
+        {
+            grav_ref_angle = grav_angle;
+            add_ball(win_size, ball_colors);
+            dirty = true;
+        }
+    }
+
+    if(sandbox.enabled)
+    {
+        spawn_accum += dt * sandbox.spawn_rate;
+        for(; spawn_accum >= 1.0f && std::size(balls) < sandbox.max_balls; spawn_accum -= 1.0f)
+        {
+            add_ball(win_size, ball_colors);
+            dirty = true;
+        }
+        spawn_accum = std::min(spawn_accum, 1.0f); // don't save up a burst while at the cap
+    }
+
+    if(pressure_overlay)
+        pressure_map.advance(dt);
+
+    // the sandbox has too many balls to test every pair, so it moves them all, then collides them through the grid
+    float compression = 0.0f;
+    if(sandbox.enabled)
+    {
+        for(auto & ball: balls)
+            ball.physics_step(dt, win_size, grav_vec, wall_damp);
+        compression = collide();
+    }
+    else
+    {
+        compression = move_and_collide(dt);
+    }
+
+    for(auto & ball: balls)
+        max_motion = std::max(max_motion, ball.get_motion());
 
-    std::vector<float> sorted_compressions(std::begin(last_compressions), std::end(last_compressions));
-    std::sort(std::begin(sorted_compressions), std::end(sorted_compressions));
-    med_compression = sorted_compressions[std::size(sorted_compressions) / 2];
+    last_compressions[oldest_compression] = compression / std::size(balls);
+    oldest_compression = (oldest_compression + 1) % num_compressions;
 
-    if(med_compression > 10.0f)
+    // partially sort a copy on the stack
+    auto sorted_compressions = last_compressions;
+    auto median = std::begin(sorted_compressions) + num_compressions / 2;
+    std::nth_element(std::begin(sorted_compressions), median, std::end(sorted_compressions));
+    med_compression = *median;
+
+    if(!sandbox.enabled && med_compression > 10.0f)
     {
         state = State::LOSE;
 
@@ -352,22 +1033,26 @@ void World::fling(float x, float y)
     {
         auto fling = -glm::normalize(glm::vec2(x, y));
         grav_vec = fling * g;
-        balls.emplace_back(win_size, ball_colors);
+        add_ball(win_size, ball_colors);
+        dirty = true;
     }
 }
 
 void World::new_game()
 {
-    balls.clear();
+    remove_all_balls();
     for(std::size_t i = 0; i < num_starting_balls; ++i)
-        balls.emplace_back(win_size, ball_colors);
+        add_ball(win_size, ball_colors);
 
-    last_compressions = std::deque<float>(100, 0.0f);
+    last_compressions.fill(0.0f);
+    oldest_compression = 0;
     med_compression = 0.0f;
     state = State::ONGOING;
     paused = false;
     score = 0;
     grav_vec = {0.0f, 0.0f};
+    pressure_map.clear();
+    dirty = true;
 }
 
 World::UI_data World::get_ui_data()
@@ -379,13 +1064,22 @@ void World::deserialize(const nlohmann::json & data, bool first_run)
 {
     if(data.find("balls") != std::end(data))
     {
-        balls.clear();
+        remove_all_balls();
         for(auto &b: data["balls"])
-            balls.emplace_back(win_size, ball_colors, b);
+            add_ball(win_size, ball_colors, b);
+        pressure_map.clear();
     }
 
     if(data.find("last_compressions") != std::end(data))
-        last_compressions = std::deque<float>(std::begin(data["last_compressions"]), std::end(data["last_compressions"]));
+    {
+        // oldest first. Only the newest num_compressions are kept, and a short history is padded at the old end with zeros
+        auto & saved = data["last_compressions"];
+        auto num_saved = std::min(std::size(saved), num_compressions);
+        last_compressions.fill(0.0f);
+        oldest_compression = 0;
+        for(std::size_t i = 0; i < num_saved; ++i)
+            last_compressions[num_compressions - num_saved + i] = saved[std::size(saved) - num_saved + i];
+    }
     if(data.find("med_compression") != std::end(data))
         med_compression = data["med_compression"];
 
@@ -409,6 +1103,8 @@ void World::deserialize(const nlohmann::json & data, bool first_run)
     if(data.find("grav_vec") != std::end(data))
         grav_vec = {data["grav_vec"][0], data["grav_vec"][1]};
 
+    dirty = true;
+
     if(first_run && state == State::LOSE)
             new_game();
 }
@@ -422,7 +1118,9 @@ nlohmann::json World::serialize() const
     for(auto &b: balls)
         data["balls"].push_back(b.serialize());
 
-    data["last_compressions"] = last_compressions;
+    data["last_compressions"] = nlohmann::json::array();
+    for(std::size_t i = 0; i < num_compressions; ++i)
+        data["last_compressions"].push_back(last_compressions[(oldest_compression + i) % num_compressions]);
     data["med_compression"] = med_compression;
 
     switch(state)
@@ -23,33 +23,61 @@
 
 #include "opengl.hpp"
 
-#include <deque>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
 #include <list>
 #include <memory>
+#include <vector>
 
 #include <android/asset_manager.h>
 
 #include <nlohmann/json.hpp>
 #include <glm/glm.hpp>
-#include <textogl/font.hpp>
-#include <textogl/static_text.hpp>
 
 #include "ball.hpp"
+#include "gpu_timer.hpp"
+#include "label_batch.hpp"
+#include "pressure_map.hpp"
+
+// free-play mode on a bigger arena, with balls spawned at a steady rate instead of by flinging. No score is kept and the game can't be lost
+struct Sandbox_config
+{
+    bool enabled = false;
+    float arena_size = 4096.0f; // width and height of the arena, in world units
+    float spawn_rate = 100.0f; // balls / s
+    std::size_t max_balls = 5000;
+};
+
+// geometry drawn around each ball by the triangle and instanced passes. TRIANGLE circumscribes the circle and is
+// shaded from gl_FragCoord. QUAD covers less area, and is shaded from interpolated local coordinates without discard
+enum class Ball_shape: std::size_t {TRIANGLE, QUAD};
 
 class World
 {
 private:
-    constexpr static float win_size = 512.0f;
+    constexpr static float default_win_size = 512.0f;
     constexpr static std::size_t num_starting_balls = 2;
+    float win_size = default_win_size; // arena size. Only differs from default_win_size in sandbox mode
     std::list<Ball> balls;
-    std::deque<float> last_compressions = std::deque<float>(100, 0.0f);
-    float med_compression;
+    std::list<Ball> free_balls; // spare nodes. Balls are spliced between the two lists, so spawning and merging don't allocate
+    constexpr static std::size_t initial_ball_pool = 128; // plenty for a normal game. The pool grows past this if it has to
+    void reserve_balls(std::size_t count);
+    template<typename... Args> void add_ball(Args &&... args);
+    void remove_ball(std::list<Ball>::iterator ball);
+    void remove_all_balls();
 
     // physics constants
     constexpr static float g = -200.0f; // free-fall gravitational acceleration
     constexpr static float e = 0.5f; // coefficient of collision restitution
     constexpr static float wall_damp = 0.9f; // % velocity lost when colliding with a wall
 
+    constexpr static std::size_t num_compressions = 100; // pressure is the median compression over this many steps
+    std::array<float, num_compressions> last_compressions {}; // ring buffer
+    std::size_t oldest_compression = 0; // index into last_compressions
+    float med_compression;
+
     enum class State {ONGOING, LOSE, EXTENDED} state = State::ONGOING;
     bool paused = false;
 
@@ -61,33 +89,156 @@ private:
     glm::vec2 grav_vec{0.0f};
     float grav_ref_angle = 0.0f;
 
+    Sandbox_config sandbox;
+    float spawn_accum = 0.0f; // fractional balls owed to the sandbox spawner
+
+    float move_and_collide(float dt); // the normal game's collisions. Sandbox uses collide
+    void ball_merged(const Ball & ball); // keeps score. ball is the merged one, after growing
+    void add_contact_pressure(const Ball & a, const Ball & b, float compression); // feeds the pressure overlay, if it's on
+
+    // uniform grid broadphase. Balls are counting-sorted into cells at least as wide as the biggest ball, so each one only
+    // needs testing against its own and neighboring cells. Buffers are kept between steps to avoid reallocating
+    constexpr static std::size_t max_grid_dim = 128;
+    struct Grid_entry
+    {
+        std::list<Ball>::iterator ball;
+        bool merged = false; // absorbed into another ball this step, erased afterwards
+    };
+    std::vector<Grid_entry> grid_entries; // sorted by cell
+    std::vector<std::uint32_t> grid_cells; // cell of each ball, in list order
+    std::vector<std::uint32_t> grid_cell_start; // index into grid_entries of each cell's first ball, plus one past the end
+    std::vector<std::uint32_t> grid_next_slot; // scratch space for filling grid_entries
+    std::size_t sort_into_grid();
+    float collide();
+
+    bool pressure_overlay = false;
+    Pressure_map pressure_map{default_win_size}; // only fed while the overlay is on
+
+    // render-on-demand tracking
+    constexpr static float motion_threshold = 0.25f; // in pixels. Skip rendering when no ball has moved more than this
+    bool dirty = true; // set when balls are added, removed, or change size
+    float max_motion = 0.0f; // farthest any ball has moved since last render, in world units
+    float drawn_text_angle = 0.0f;
+    float text_angle() const;
+
     glm::vec2 screen_size;
     glm::mat3 projection;
+    float get_pixel_scale() const { return std::min(screen_size.x, screen_size.y) / win_size; } // screen pixels per world unit
+
+    // uniforms used by all of the ball programs. Not all programs use all of them
+    struct Ball_uniforms
+    {
+        Uniform<glm::mat3> projection;
+        Uniform<glm::mat3> inv_projection;
+        Uniform<glm::vec2> screen_size;
+        Uniform<GLfloat> win_size;
+        Uniform<glm::vec4> palette;
+    };
+
+    struct Ball_shape_data
+    {
+        const char * name;
+        std::vector<GLubyte> corners;
+        std::unique_ptr<Shader_prog> prog;
+        Ball_uniforms uniforms;
+        std::unique_ptr<GL_buffer> corner_vbo; // only used for instanced rendering
+    };
+    std::array<Ball_shape_data, 2> ball_shapes {{{"triangle", {0, 1, 2}}, {"quad", {0, 1, 2, 0, 2, 3}}}};
+    Ball_shape ball_shape = Ball_shape::QUAD;
+    Ball_shape_data & get_ball_shape() { return ball_shapes[static_cast<std::size_t>(ball_shape)]; }
+    void init_ball_shape(Ball_shape shape, AAsset * vert_asset, AAsset * frag_asset);
+
+    std::unique_ptr<Program_cache> program_cache;
+    std::unique_ptr<Streaming_buffer> ball_stream;
+    bool instanced = false;
+    std::unique_ptr<Shader_prog> point_prog; // only used for GL ES 2
+    Ball_uniforms point_uniforms;
+    float max_point_size = 1.0f;
+    std::unique_ptr<Shader_prog> flat_prog;
+    Ball_uniforms flat_uniforms;
 
-    std::unique_ptr<Shader_prog> ball_prog;
-    std::unique_ptr<GL_buffer> ball_vbo;
+    // packed vertex formats. Positions are normalized to win_size, and color and radius are looked up from size in the shader's palette
+    using Ball_vertex = Vertex_layout<Vertex_attrib<GLushort, 2, GL_TRUE>, Vertex_attrib<GLubyte, 1>, Vertex_attrib<GLubyte, 1>>; // pos, size, corner
+    using Ball_instance = Vertex_layout<Vertex_attrib<GLushort, 2, GL_TRUE>, Vertex_attrib<GLubyte, 1>>; // pos, size
+    using Ball_corner = Vertex_layout<Vertex_attrib<GLubyte, 1>>; // corner
+    constexpr static int palette_size = 32; // must match the palette uniform in the ball shaders
 
-    constexpr static std::size_t num_ball_attrs = 8;
-    std::vector<float> ball_data = std::vector<float>(64 * num_ball_attrs * 3); // scratch buffer for ball data
+    // level of detail by on-screen radius. FULL is shaded and labelled, NO_LABEL is shaded, and FLAT is a single color point sprite.
+    // Every ball of a size is the same size on screen, so tiers are kept per size
+    enum class Ball_lod: std::size_t {FULL, NO_LABEL, FLAT};
+    constexpr static float label_lod_radius = 8.0f; // in pixels. Smaller balls aren't labelled
+    constexpr static float flat_lod_radius = 4.0f; // in pixels. At this size the border and antialiasing are about a pixel wide, so smaller balls are drawn flat
+    constexpr static float lod_hysteresis = 0.15f; // fraction of a threshold the radius must cross it by to change tiers, so resizing near one doesn't pop
+    bool lod_enabled = true;
+    std::array<Ball_lod, palette_size> size_lods {};
+    std::array<std::size_t, 3> lod_counts {}; // balls in each tier, counted at the start of each frame
+    void update_lods();
+    void count_lods();
+    Ball_lod get_lod(const Ball & ball) const { return size_lods[pack_size(ball.get_size())[0]]; }
 
-    AAsset * font_asset = nullptr;
+    std::vector<std::uint8_t> ball_data = std::vector<std::uint8_t>(64 * 6 * Ball_vertex::stride); // scratch buffer for ball data
+    void grow_ball_data(std::size_t data_size);
+    void upload_palette(const Shader_prog & prog, const Uniform<glm::vec4> & palette_uniform);
+
+    AAsset * label_atlas_asset = nullptr;
     AAsset * vert_shader_asset = nullptr;
     AAsset * frag_shader_asset = nullptr;
+    AAsset * point_vert_shader_asset = nullptr;
+    AAsset * point_frag_shader_asset = nullptr;
+    AAsset * flat_vert_shader_asset = nullptr;
+    AAsset * flat_frag_shader_asset = nullptr;
+    AAsset * quad_vert_shader_asset = nullptr;
+    AAsset * quad_frag_shader_asset = nullptr;
+    AAsset * pressure_vert_shader_asset = nullptr;
+    AAsset * pressure_frag_shader_asset = nullptr;
+    AAsset * label_vert_shader_asset = nullptr;
+    AAsset * label_frag_shader_asset = nullptr;
 
     constexpr static int initial_text_size = 14;
+    constexpr static int min_text_size = 6; // labels smaller than this are unreadable, so they aren't drawn
     int text_size = initial_text_size;
-    std::unique_ptr<textogl::Font_sys> font;
-    std::vector<textogl::Static_text> ball_texts;
+    std::unique_ptr<Label_batch> labels;
+    unsigned long label_bytes = 0;
+
+    std::unique_ptr<Gpu_timer> gpu_timer;
 
     glm::vec2 text_coord_transform(const glm::vec2 & coord);
 
     glm::vec4 bg_color;
     std::vector<glm::vec4> ball_colors;
 
-    void render_balls();
+    // ways to draw the balls. each returns the number of bytes uploaded
+    enum class Ball_pass: std::size_t {TRIANGLES, INSTANCED, POINTS, FLAT}; // FLAT is only for FLAT LOD balls, drawn after one of the others
+    struct Ball_pass_stats
+    {
+        const char * name;
+        unsigned long frames = 0;
+        unsigned long long bytes = 0;
+        std::chrono::duration<float> time{0.0f}; // CPU time to pack, upload and submit
+    };
+    std::array<Ball_pass_stats, 4> ball_pass_stats {{{"triangles"}, {"instanced"}, {"points"}, {"flat"}}};
+
+    // one VAO per ball pass, shape, and ball_stream region, so attributes only need to be specified when the region moves
+    struct Ball_vao
+    {
+        Vertex_array vao;
+        GLintptr offset = -1;
+    };
+    std::array<std::array<std::vector<Ball_vao>, 2>, 4> ball_vaos;
+    bool bind_ball_vao(Ball_pass pass, GLintptr offset);
+
+    Ball_pass choose_ball_pass() const;
+    GLintptr upload_ball_instances(bool flat); // just the FLAT LOD balls, or all of the others
+    std::array<GLushort, 2> pack_pos(const glm::vec2 & pos) const;
+    static std::array<GLubyte, 1> pack_size(int size);
+    std::size_t render_balls();
+    std::size_t render_balls_instanced(); // GL ES 3.0 only
+    std::size_t render_balls_points();
+    std::size_t render_balls_flat();
+    std::size_t render_ball_pass(Ball_pass pass);
 
 public:
-    World(AAssetManager * asset_manager, bool gravity_mode);
+    World(AAssetManager * asset_manager, bool gravity_mode, const Sandbox_config & sandbox = {});
     ~World();
     World(const World &) = delete;
     World(World &&) = default;
@@ -95,19 +246,28 @@ public:
     World & operator=(const World &) = delete;
     World & operator=(World &&) = default;
 
-    void init();
+    void init(bool gles3, const std::string & shader_cache_dir);
     void destroy();
     void pause();
     bool is_paused() const;
+    bool is_idle() const;
     void unpause();
     void resize(GLsizei width, GLsizei height);
-    bool render();
+    bool needs_render() const;
+    void render();
     void physics_step(float dt, const glm::vec2 & grav_sensor_vec);
 
     void fling(float x, float y);
 
     void new_game();
 
+    void log_render_stats() const;
+    const Gpu_timer * get_gpu_timer() const { return gpu_timer.get(); } // per-pass GPU time histograms. null before init
+    void set_lod_enabled(bool enabled); // when disabled, every ball is drawn at FULL detail. For comparing draw times
+    void set_pressure_overlay(bool enabled); // heatmap of where balls are being squeezed together
+    void set_ball_shape(Ball_shape shape); // QUAD unless changed. For comparing fill rates
+
+    // shared with MainActivity.read_ui_data through a Seqlock, so the layout must stay in sync with it
     struct UI_data
     {
         int score;
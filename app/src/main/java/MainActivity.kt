@@ -51,6 +51,9 @@ import androidx.fragment.app.DialogFragment
 import androidx.preference.PreferenceManager
 import org.mattvchandler.a2050.databinding.ActivityMainBinding
 import java.io.IOException
+import java.lang.invoke.VarHandle
+import java.nio.ByteBuffer
+import java.nio.ByteOrder
 
 class MainActivity: Themed_activity(), SurfaceHolder.Callback
 {
@@ -58,6 +61,8 @@ class MainActivity: Themed_activity(), SurfaceHolder.Callback
 
     private lateinit var binding: ActivityMainBinding
     private val data = DispData()
+    private lateinit var ui_data_buffer: ByteBuffer
+    private val ui_data_fence = Any()
     private val update_data = Handler(Looper.getMainLooper())
     private var dialog: AlertDialog? = null
 
@@ -76,7 +81,8 @@ class MainActivity: Themed_activity(), SurfaceHolder.Callback
         @JvmStatic private external fun ballColorIndex(size: Int, num_colors: Int): Int
     }
 
-    private external fun create(assetManager: AssetManager, path: String, resources: Resources, gravity_mode: Boolean, rotation: Int)
+    private external fun create(assetManager: AssetManager, path: String, resources: Resources, gravity_mode: Boolean, rotation: Int,
+                                pressure_overlay: Boolean, sandbox: Boolean, sandbox_arena_size: Float, sandbox_spawn_rate: Float, sandbox_max_balls: Int)
     private external fun resume()
     private external fun pause()
     private external fun stop()
@@ -86,13 +92,14 @@ class MainActivity: Themed_activity(), SurfaceHolder.Callback
     private external fun fling(x: Float, y: Float)
     private external fun newGame()
     private external fun pauseGame()
-    private external fun getUIData(data: DispData)
+    private external fun getUIDataBuffer(): ByteBuffer
 
     override fun onCreate(savedInstanceState: Bundle?)
     {
         super.onCreate(savedInstanceState)
 
-        gravity_mode = PreferenceManager.getDefaultSharedPreferences(this).getBoolean("gravity", false)
+        val prefs = PreferenceManager.getDefaultSharedPreferences(this)
+        gravity_mode = prefs.getBoolean("gravity", false)
         if(gravity_mode)
         {
             requestedOrientation = ActivityInfo.SCREEN_ORIENTATION_LANDSCAPE
@@ -133,7 +140,50 @@ class MainActivity: Themed_activity(), SurfaceHolder.Callback
 
         val rotation = DisplayManagerCompat.getInstance(this).getDisplay(Display.DEFAULT_DISPLAY)?.rotation
 
-        create(resources.assets, path, resources, gravity_mode, rotation!!)
+        // defaults must match settings.xml
+        create(resources.assets, path, resources, gravity_mode, rotation!!,
+               prefs.getBoolean("pressure_overlay", false),
+               prefs.getBoolean("sandbox", false),
+               512.0f * prefs.getInt("sandbox_arena_scale", 8),
+               prefs.getInt("sandbox_spawn_rate", 100).toFloat(),
+               prefs.getInt("sandbox_max_balls", 5000))
+        ui_data_buffer = getUIDataBuffer().order(ByteOrder.nativeOrder())
+    }
+
+    private fun load_fence()
+    {
+        if(Build.VERSION.SDK_INT >= 33)
+            VarHandle.acquireFence()
+        else
+            synchronized(ui_data_fence) {} // monitor enter / exit are full barriers on ART
+    }
+
+    // read the latest World::UI_data published by the engine's Seqlock (see seqlock.hpp for the layout), without locking or JNI calls
+    private fun read_ui_data()
+    {
+        while(true)
+        {
+            val sequence = ui_data_buffer.getInt(0)
+            if((sequence and 1) != 0) // write in progress
+                continue
+            load_fence()
+
+            val score = ui_data_buffer.getInt(4)
+            val high_score = ui_data_buffer.getInt(8)
+            val grav_angle = ui_data_buffer.getFloat(12)
+            val pressure = ui_data_buffer.getInt(16)
+
+            load_fence()
+            if(ui_data_buffer.getInt(0) != sequence)
+                continue
+
+            // these only notify observers when the value changes
+            data.score.set(score)
+            data.high_score.set(high_score)
+            data.grav_angle.set(grav_angle)
+            data.pressure.set(pressure)
+            return
+        }
     }
 
     override fun onResume()
@@ -150,7 +200,7 @@ class MainActivity: Themed_activity(), SurfaceHolder.Callback
         {
             override fun run()
             {
-                getUIData(data)
+                read_ui_data()
 
                 val color_stops = resources.getIntArray(R.array.pressure_colors)
                 if(color_stops.size <= 1)
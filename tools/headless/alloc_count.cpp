@@ -0,0 +1,65 @@
+// Copyright 2022 Matthew Chandler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "alloc_count.hpp"
+
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+    // per thread, so the driver's worker threads don't show up in the render thread's count
+    thread_local std::uint64_t count = 0;
+
+    void * counted_alloc(std::size_t size)
+    {
+        ++count;
+        return std::malloc(size ? size : 1);
+    }
+}
+
+namespace alloc_count
+{
+    std::uint64_t get() { return count; }
+}
+
+// the aligned overloads are left alone. Their default implementations don't go through these
+void * operator new(std::size_t size)
+{
+    if(auto ptr = counted_alloc(size))
+        return ptr;
+    throw std::bad_alloc{};
+}
+void * operator new[](std::size_t size)
+{
+    if(auto ptr = counted_alloc(size))
+        return ptr;
+    throw std::bad_alloc{};
+}
+void * operator new(std::size_t size, const std::nothrow_t &) noexcept { return counted_alloc(size); }
+void * operator new[](std::size_t size, const std::nothrow_t &) noexcept { return counted_alloc(size); }
+
+void operator delete(void * ptr) noexcept { std::free(ptr); }
+void operator delete[](void * ptr) noexcept { std::free(ptr); }
+void operator delete(void * ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[](void * ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete(void * ptr, const std::nothrow_t &) noexcept { std::free(ptr); }
+void operator delete[](void * ptr, const std::nothrow_t &) noexcept { std::free(ptr); }
@@ -0,0 +1,1272 @@
+// Copyright 2022 Matthew Chandler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// offscreen rendering backend for World, for machines without a GPU or display (ie: Mesa's llvmpipe).
+// Renders fixed scenes into an FBO on a surfaceless EGL context at several resolutions, times the render path,
+// and compares the results against golden images:
+//   headless [--gles2] [--frames N] [--out DIR] [--golden DIR] [--update-golden] [--trace FILE] [--stress SECONDS] [--sandbox BALLS]
+//            [--versus SECONDS] [--latency MS] [--jitter MS] [--pressure] [--alloc-check SECONDS] [--seqlock-check SECONDS] [--gravity-trace FILE]
+//            [--event-latency SECONDS] [--jni-call-us US] [--fill-rate] [--histogram-check] [--log FILE]
+// --trace writes Chrome trace JSON, and needs a build with -DTRACING=ON
+// --stress skips the images, and instead runs Engine_core's physics loop and locked entry points from their own threads, at
+// roughly the rates the app calls them, then reports each site's lock wait and hold times. Fails if any site was never
+// locked, or the UI thread read torn UI data
+// --sandbox fills a sandbox mode arena with BALLS balls, lets them fall into a pile, and reports physics step and frame times,
+// with and without level of detail. The last frame of each is written to the output directory
+// --versus plays two randomly flinging peers against each other through Rollback_session, over a loopback link with
+// --latency and --jitter (ms). Fails if the peers ever disagree about a confirmed tick, or differ from a Versus_world simulated
+// straight through with the same inputs. The final state is drawn to versus.ppm
+// --pressure turns on the pressure heatmap overlay. Mostly useful with --sandbox, as the fixed scenes never collide
+// --alloc-check runs a sandbox with balls spawning and merging, alongside a gravity mode game fed from gravity_trace.txt that
+// keeps winning and losing. Fails if physics_step, the gravity filter or render make any heap allocations once it's warmed up,
+// or if no game events were posted while checking. See alloc_count.hpp
+// --gravity-trace plays a recorded accelerometer trace (ie: gravity_trace.txt here) through the gravity filter stages on a
+// simulated clock, and checks that replaying it gives the same result. See run_gravity_trace
+// --seqlock-check has one thread write UI data through a Seqlock while three others read it, and fails if any read is torn
+// --event-latency plays games with game_win, game_over and achievement stubbed, with and without the Event_dispatcher thread,
+// and reports physics step times for each. The stubs spin for --jni-call-us (default 0), so real JNI costs are not measured
+// --fill-rate draws large, overlapping balls to a 2048 x 2048 target with each ball shape, and reports frame times for each
+// --histogram-check fills Time_histograms with known durations, including ones past the last bucket's lower edge, and fails
+// if any percentile is out of order or outside its bucket
+// --log writes the app's log to FILE instead of stderr
+// Exits with a failure if any image doesn't match its golden image, or any check fails. Golden images rendered with llvmpipe
+// are kept in golden/, and ctest runs the scenes against them, along with the checks. See CMakeLists.txt
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <png.h>
+
+#include "alloc_count.hpp"
+#include "engine_core.hpp"
+#include "gravity.hpp"
+#include "histogram.hpp"
+#include "jni.hpp"
+#include "jni_stub.hpp"
+#include "log_ring.hpp"
+#include "profiled_mutex.hpp"
+#include "rollback.hpp"
+#include "seqlock.hpp"
+#include "trace.hpp"
+#include "versus_world.hpp"
+#include "world.hpp"
+
+struct Options
+{
+    bool gles2 = false;
+    int frames = 60;
+    std::string out_dir = "headless_out";
+    std::string golden_dir;
+    bool update_golden = false;
+    std::string trace_path;
+    std::string log_path;
+    float stress_seconds = 0.0f;
+    std::size_t sandbox_balls = 0;
+    float versus_seconds = 0.0f;
+    float latency_ms = 60.0f;
+    float jitter_ms = 20.0f;
+    bool pressure = false;
+    float alloc_check_seconds = 0.0f;
+    float seqlock_check_seconds = 0.0f;
+    std::string gravity_trace_path;
+    float event_latency_seconds = 0.0f;
+    int jni_call_us = 0;
+    bool fill_rate = false;
+    bool histogram_check = false;
+};
+
+constexpr float sandbox_arena_size = 4096.0f;
+
+struct Scene
+{
+    std::string name;
+    nlohmann::json data;
+};
+
+struct Resolution
+{
+    GLsizei width, height;
+};
+
+const Resolution resolutions[] = {{480, 800}, {1080, 1920}, {1440, 2560}, {1920, 1080}};
+
+// per-channel difference allowed before a pixel counts as different, and the fraction of pixels that may differ
+constexpr int pixel_tolerance = 2;
+constexpr float mismatch_tolerance = 0.001f;
+
+nlohmann::json make_ball(int size, float x, float y)
+{
+    return {{"size", size}, {"pos", {x, y}}, {"vel", {0.0f, 0.0f}}};
+}
+
+// scenes are in World's 512 x 512 coordinates
+std::vector<Scene> make_scenes()
+{
+    std::vector<Scene> scenes;
+
+    scenes.push_back({"new_game", {{"balls", {make_ball(1, 180.0f, 200.0f), make_ball(2, 330.0f, 300.0f)}}, {"state", "ONGOING"}}});
+
+    nlohmann::json midgame = nlohmann::json::array();
+    for(int i = 0; i < 12; ++i)
+        midgame.push_back(make_ball(1 + i % 8, 60.0f + 130.0f * (i % 4), 80.0f + 150.0f * (i / 4)));
+    scenes.push_back({"midgame", {{"balls", midgame}, {"state", "ONGOING"}}});
+
+    nlohmann::json crowded = nlohmann::json::array();
+    for(int i = 0; i < 40; ++i)
+        crowded.push_back(make_ball(3 + i % 7, 32.0f + 64.0f * (i % 8), 51.0f + 102.0f * (i / 8)));
+    scenes.push_back({"crowded", {{"balls", crowded}, {"state", "ONGOING"}}});
+
+    return scenes;
+}
+
+struct Image
+{
+    int width = 0, height = 0;
+    std::vector<std::uint8_t> rgb; // top row first
+};
+
+Image read_pixels(GLsizei width, GLsizei height)
+{
+    std::vector<std::uint8_t> rgba(static_cast<std::size_t>(width * height * 4));
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, std::data(rgba));
+
+    Image image{width, height, std::vector<std::uint8_t>(static_cast<std::size_t>(width * height * 3))};
+    for(int y = 0; y < height; ++y)
+    {
+        for(int x = 0; x < width; ++x)
+        {
+            auto src = &rgba[((height - 1 - y) * width + x) * 4];
+            std::copy_n(src, 3, &image.rgb[(y * width + x) * 3]);
+        }
+    }
+    return image;
+}
+
+bool write_ppm(const std::string & path, const Image & image)
+{
+    std::ofstream file(path, std::ios::binary);
+    file << "P6\n" << image.width << ' ' << image.height << "\n255\n";
+    file.write(reinterpret_cast<const char *>(std::data(image.rgb)), static_cast<std::streamsize>(std::size(image.rgb)));
+    return static_cast<bool>(file);
+}
+
+// golden images are PNG, so they're small enough to keep in the repo. Everything else is written as PPM
+bool write_png(const std::string & path, const Image & image)
+{
+    png_image png {};
+    png.version = PNG_IMAGE_VERSION;
+    png.width = static_cast<png_uint_32>(image.width);
+    png.height = static_cast<png_uint_32>(image.height);
+    png.format = PNG_FORMAT_RGB;
+    return png_image_write_to_file(&png, path.c_str(), 0, std::data(image.rgb), 0, nullptr) != 0;
+}
+
+bool read_png(const std::string & path, Image & image)
+{
+    png_image png {};
+    png.version = PNG_IMAGE_VERSION;
+    if(!png_image_begin_read_from_file(&png, path.c_str()))
+        return false;
+
+    png.format = PNG_FORMAT_RGB;
+    image.width = static_cast<int>(png.width);
+    image.height = static_cast<int>(png.height);
+    image.rgb.resize(PNG_IMAGE_SIZE(png));
+    if(!png_image_finish_read(&png, nullptr, std::data(image.rgb), 0, nullptr))
+    {
+        png_image_free(&png);
+        return false;
+    }
+    return true;
+}
+
+// fraction of pixels that differ by more than pixel_tolerance in any channel
+float compare_images(const Image & a, const Image & b)
+{
+    if(a.width != b.width || a.height != b.height)
+        return 1.0f;
+
+    std::size_t mismatched = 0;
+    for(std::size_t i = 0; i < std::size(a.rgb); i += 3)
+    {
+        for(std::size_t c = 0; c < 3; ++c)
+        {
+            if(std::abs(static_cast<int>(a.rgb[i + c]) - static_cast<int>(b.rgb[i + c])) > pixel_tolerance)
+            {
+                ++mismatched;
+                break;
+            }
+        }
+    }
+    return static_cast<float>(mismatched) / static_cast<float>(a.width * a.height);
+}
+
+class Offscreen_context
+{
+private:
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLSurface surface = EGL_NO_SURFACE;
+    EGLContext context = EGL_NO_CONTEXT;
+
+public:
+    explicit Offscreen_context(int gl_version)
+    {
+        // prefer a surfaceless display, so no window system is needed at all
+        auto get_platform_display = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+        if(get_platform_display)
+            display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+        if(display == EGL_NO_DISPLAY)
+            display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+        if(display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr))
+            throw std::runtime_error("Could not initialize EGL display");
+
+        eglBindAPI(EGL_OPENGL_ES_API);
+
+        EGLint config_attribs[] =
+        {
+            EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+            EGL_RENDERABLE_TYPE, gl_version >= 3 ? EGL_OPENGL_ES3_BIT_KHR : EGL_OPENGL_ES2_BIT,
+            EGL_RED_SIZE,   8,
+            EGL_GREEN_SIZE, 8,
+            EGL_BLUE_SIZE,  8,
+            EGL_ALPHA_SIZE, 8,
+            EGL_NONE
+        };
+        EGLConfig config;
+        EGLint num_configs = 0;
+        if(!eglChooseConfig(display, config_attribs, &config, 1, &num_configs) || num_configs < 1)
+            throw std::runtime_error("No EGL config for GL ES " + std::to_string(gl_version));
+
+        EGLint context_attribs[] = {EGL_CONTEXT_CLIENT_VERSION, gl_version, EGL_NONE};
+        context = eglCreateContext(display, config, EGL_NO_CONTEXT, context_attribs);
+        if(context == EGL_NO_CONTEXT)
+            throw std::runtime_error("Could not create GL ES " + std::to_string(gl_version) + " context");
+
+        // everything is drawn to an FBO, but a 1x1 pbuffer is needed without EGL_KHR_surfaceless_context
+        auto extensions = eglQueryString(display, EGL_EXTENSIONS);
+        if(!extensions || !std::strstr(extensions, "EGL_KHR_surfaceless_context"))
+        {
+            EGLint pbuffer_attribs[] = {EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE};
+            surface = eglCreatePbufferSurface(display, config, pbuffer_attribs);
+        }
+
+        if(!eglMakeCurrent(display, surface, surface, context))
+            throw std::runtime_error("Could not make context current");
+
+        std::cout << "renderer: " << glGetString(GL_RENDERER) << " (" << glGetString(GL_VERSION) << ")\n";
+    }
+    ~Offscreen_context()
+    {
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if(surface != EGL_NO_SURFACE)
+            eglDestroySurface(display, surface);
+        eglDestroyContext(display, context);
+        eglTerminate(display);
+    }
+    Offscreen_context(const Offscreen_context &) = delete;
+    Offscreen_context & operator=(const Offscreen_context &) = delete;
+};
+
+class Render_target
+{
+private:
+    GLuint framebuffer = 0, renderbuffer = 0;
+
+public:
+    Render_target(GLsizei width, GLsizei height)
+    {
+        glGenRenderbuffers(1, &renderbuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, renderbuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffer);
+
+        if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            throw std::runtime_error("Incomplete framebuffer at " + std::to_string(width) + "x" + std::to_string(height));
+    }
+    ~Render_target()
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glDeleteFramebuffers(1, &framebuffer);
+        glDeleteRenderbuffers(1, &renderbuffer);
+    }
+    Render_target(const Render_target &) = delete;
+    Render_target & operator=(const Render_target &) = delete;
+};
+
+// render each scene at each resolution, and compare against the golden images. Returns false on any mismatch
+bool run_scenes(World & world, const Options & options, int gl_version)
+{
+    bool passed = true;
+    auto scenes = make_scenes();
+
+
+    std::cout << "scene        resolution     ms / frame  golden\n";
+    for(auto & res: resolutions)
+    {
+        Render_target target(res.width, res.height);
+        world.resize(res.width, res.height);
+
+        for(auto & scene: scenes)
+        {
+            world.deserialize(scene.data, false);
+
+            // the first frame is the one compared, before timing, so it includes any lazy setup
+            world.render();
+            auto image = read_pixels(res.width, res.height);
+
+            auto start = std::chrono::steady_clock::now();
+            for(int i = 0; i < options.frames; ++i)
+                world.render();
+            glFinish();
+            std::chrono::duration<float> time = std::chrono::steady_clock::now() - start;
+
+            auto name = scene.name + "_" + std::to_string(res.width) + "x" + std::to_string(res.height) + "_gles" + std::to_string(gl_version);
+            write_ppm(options.out_dir + "/" + name + ".ppm", image);
+
+            std::string golden_result = "-";
+            if(options.update_golden)
+            {
+                golden_result = write_png(options.golden_dir + "/" + name + ".png", image) ? "updated" : "write failed";
+            }
+            else if(!std::empty(options.golden_dir))
+            {
+                Image golden;
+                if(!read_png(options.golden_dir + "/" + name + ".png", golden))
+                {
+                    golden_result = "missing";
+                    passed = false;
+                }
+                else
+                {
+                    auto mismatch = compare_images(image, golden);
+                    if(mismatch > mismatch_tolerance)
+                    {
+                        golden_result = "FAIL (" + std::to_string(100.0f * mismatch) + "% differ)";
+                        passed = false;
+                    }
+                    else
+                    {
+                        golden_result = "ok";
+                    }
+                }
+            }
+
+            std::printf("%-12s %4dx%-4d      %8.3f    %s\n", scene.name.c_str(), res.width, res.height,
+                        1000.0f * time.count() / static_cast<float>(options.frames), golden_result.c_str());
+        }
+    }
+    return passed;
+}
+
+// Engine with the EGL and sensors left out. The render loop draws to the current framebuffer, locking as
+// Engine::render_loop does. Everything else, including the physics loop and every other lock site, is Engine_core's
+class Stress_engine: public Engine_core
+{
+public:
+    using Engine_core::Engine_core;
+
+    void init(bool gles3, const std::string & shader_cache_dir, GLsizei width, GLsizei height, const nlohmann::json & data)
+    {
+        world.init(gles3, shader_cache_dir);
+        world.resize(width, height);
+        world.deserialize(data, false);
+        publish_ui_data();
+    }
+    void destroy() { world.destroy(); }
+
+    // glFinish stands in for eglSwapBuffers, which Engine also calls with the lock held. Returns the number of frames drawn
+    unsigned long render_loop(std::chrono::steady_clock::time_point end_time)
+    {
+        TRACE_THREAD_NAME("render");
+        const std::chrono::microseconds target_frametime{33333};
+        unsigned long frames = 0;
+        while(std::chrono::steady_clock::now() < end_time)
+        {
+            auto frame_start_time = std::chrono::steady_clock::now();
+            {
+                Profiled_mutex::Lock lock(mutex, "render_loop");
+                if(has_surface && (redraw || world.needs_render()))
+                {
+                    world.render();
+                    glFinish();
+                    ++frame_stats.rendered;
+                    ++frames;
+                }
+                redraw = false;
+            }
+            std::this_thread::sleep_until(frame_start_time + target_frametime);
+        }
+        return frames;
+    }
+};
+
+// runs Engine_core's physics loop and locked entry points from threads at roughly the rates the app calls them, then reports
+// each site's lock wait and hold times. Fails if any site was never locked, or if the UI thread ever read UI data that no
+// single physics step could have published
+bool run_stress(AAssetManager & assets, const Options & options, int gl_version)
+{
+    constexpr GLsizei width = 1080, height = 1920;
+    Render_target target(width, height);
+
+    Stress_engine engine(&assets, false);
+    engine.init(gl_version >= 3, options.out_dir + "/shader_cache", width, height, make_scenes().back().data);
+
+    ANativeWindow window {width, height};
+    engine.surface_changed(&window);
+
+    engine.start_loops();
+    std::thread physics([&engine]() { engine.physics_loop(nullptr, 0); });
+
+    // the UI thread reads its data every frame without locking, and input arrives at random. Scores only go up between new
+    // games, and the high score never goes down, so a read that mixes two writes is likely to break one of those
+    std::atomic<bool> ui_running = true;
+    unsigned long ui_reads = 0, torn_reads = 0;
+    std::thread ui([&]()
+    {
+        TRACE_THREAD_NAME("ui");
+        std::mt19937 rng(2050);
+        std::uniform_real_distribution<float> fling_dist(-1.0f, 1.0f);
+        std::uniform_int_distribution<int> event_dist(0, 99);
+        const std::chrono::microseconds target_frametime{16667};
+
+        int last_high_score = 0;
+        unsigned long ui_frame = 0;
+        while(ui_running)
+        {
+            auto frame_start_time = std::chrono::steady_clock::now();
+
+            auto data = engine.read_ui_data();
+            ++ui_reads;
+            if(data.score < 0 || data.score > data.high_score || data.high_score < last_high_score || !std::isfinite(data.grav_angle) || data.pressure < 0)
+                ++torn_reads;
+            last_high_score = data.high_score;
+
+            // flings are random. Everything else takes turns, each about once every 50 frames, so every site is hit even in
+            // a short run
+            if(event_dist(rng) < 20)
+            {
+                auto x = fling_dist(rng), y = fling_dist(rng);
+                engine.fling(x, y);
+            }
+            if(ui_frame % 10 == 0)
+            {
+                switch((ui_frame / 10) % 5)
+                {
+                case 0:
+                    engine.new_game();
+                    break;
+                case 1:
+                    engine.pause_game();
+                    engine.unpause();
+                    break;
+                case 2:
+                    engine.is_paused();
+                    break;
+                case 3:
+                    // the surface going away and coming back, as on rotation
+                    engine.surface_changed(nullptr);
+                    engine.surface_changed(&window);
+                    break;
+                case 4:
+                    engine.get_frame_stats();
+                    break;
+                }
+            }
+            ++ui_frame;
+            std::this_thread::sleep_until(frame_start_time + target_frametime);
+        }
+    });
+
+    auto end_time = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<float>(options.stress_seconds));
+    auto frames = engine.render_loop(end_time);
+
+    ui_running = false;
+    ui.join();
+    engine.stop_loops();
+    physics.join();
+
+    std::printf("%lu frames rendered in %.1f s. %lu UI data reads, %lu torn\n", frames, options.stress_seconds, ui_reads, torn_reads);
+    std::printf("%-16s %8s %10s %10s %10s %10s %10s %10s\n", "site", "locks", "wait p50", "wait p99", "wait max", "hold p50", "hold p99", "hold max");
+
+    auto report = engine.get_lock_report();
+    for(auto & site: report)
+    {
+        std::printf("%-16s %8lu %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f\n", site.name, site.wait.get_count(),
+                    site.wait.percentile_ms(0.5f), site.wait.percentile_ms(0.99f), site.wait.max_ms(),
+                    site.hold.percentile_ms(0.5f), site.hold.percentile_ms(0.99f), site.hold.max_ms());
+    }
+    std::printf("(ms. percentiles are bucket upper bounds)\n");
+
+    bool passed = frames > 0 && ui_reads > 0 && torn_reads == 0;
+    for(auto name: {"physics_loop", "render_loop", "fling", "new_game", "pause_game", "unpause", "is_paused", "surface_changed", "get_frame_stats", "pause"})
+    {
+        auto site = std::find_if(std::begin(report), std::end(report), [name](auto & site) { return std::strcmp(site.name, name) == 0; });
+        if(site == std::end(report) || site->wait.get_count() == 0)
+        {
+            std::printf("%s was never locked\n", name);
+            passed = false;
+        }
+    }
+
+    engine.destroy();
+    return passed;
+}
+
+void run_sandbox(World & world, std::size_t num_balls, int frames, const std::string & out_dir)
+{
+    constexpr GLsizei width = 1080, height = 1920;
+    Render_target target(width, height);
+    world.resize(width, height);
+
+    // a checkerboard of sizes 1 and 2, so no two neighbors start out able to merge
+    auto grid_size = static_cast<std::size_t>(std::ceil(std::sqrt(static_cast<float>(num_balls))));
+    auto spacing = sandbox_arena_size / static_cast<float>(grid_size);
+    nlohmann::json balls = nlohmann::json::array();
+    for(std::size_t i = 0; i < num_balls; ++i)
+    {
+        auto x = i % grid_size, y = i / grid_size;
+        balls.push_back(make_ball(1 + static_cast<int>((x + y) % 2), (static_cast<float>(x) + 0.5f) * spacing, (static_cast<float>(y) + 0.5f) * spacing));
+    }
+
+    auto time_ns = [](auto && f)
+    {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+    };
+
+    std::printf("sandbox: %zu balls in a %.0f arena at %d x %d\n", num_balls, sandbox_arena_size, width, height);
+    std::printf("%-16s %8s %10s %10s %10s %10s\n", "", "count", "mean", "p50", "p95", "max");
+    auto print_row = [](const char * name, const Time_histogram & hist)
+    {
+        std::printf("%-16s %8lu %10.3f %10.3f %10.3f %10.3f\n", name, hist.get_count(),
+                    hist.mean_ms(), hist.percentile_ms(0.5f), hist.percentile_ms(0.95f), hist.max_ms());
+    };
+
+    // the same run with every ball at full detail, then with LOD tiers, to show what they save
+    for(auto lod: {false, true})
+    {
+        world.set_lod_enabled(lod);
+        world.deserialize({{"balls", balls}, {"state", "ONGOING"}}, false);
+        world.fling(0.0f, 1.0f); // turn gravity on, so the balls pile up and collide
+
+        Time_histogram physics_ticks, frame_times;
+
+        // 100 Hz physics against 60 fps rendering
+        float physics_time = 0.0f;
+        for(int frame = 0; frame < frames; ++frame)
+        {
+            for(physics_time += 1.0f / 60.0f; physics_time >= 0.01f; physics_time -= 0.01f)
+                physics_ticks.add(time_ns([&]{ world.physics_step(0.01f, {0.0f, -1.0f}); }));
+            frame_times.add(time_ns([&]{ world.render(); glFinish(); }));
+        }
+
+        write_ppm(out_dir + (lod ? "/sandbox_lod.ppm" : "/sandbox.ppm"), read_pixels(width, height));
+
+        print_row(lod ? "physics (LOD)" : "physics", physics_ticks);
+        print_row(lod ? "frame (LOD)" : "frame", frame_times);
+    }
+    std::printf("(ms. percentiles are bucket upper bounds. budgets are 10 ms / step and 16.7 ms / frame)\n");
+}
+
+// large, overlapping balls drawn to a large target with each ball shape, so the frame time is mostly fill. Labels and the
+// clear are the same for every shape, so the difference between rows is down to the ball pass
+void run_fill_rate(World & world, int frames)
+{
+    constexpr GLsizei requested_target_size = 2048;
+    constexpr int grid_size = 6;
+
+    GLint max_renderbuffer_size = 0;
+    glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, &max_renderbuffer_size);
+    auto target_size = std::min(requested_target_size, static_cast<GLsizei>(max_renderbuffer_size));
+
+    Render_target target(target_size, target_size);
+    world.resize(target_size, target_size);
+
+    // in World's 512 x 512 coordinates. Big enough that each ball overlaps its neighbors
+    nlohmann::json balls = nlohmann::json::array();
+    for(int y = 0; y < grid_size; ++y)
+    {
+        for(int x = 0; x < grid_size; ++x)
+            balls.push_back(make_ball(10 + (x + y) % 4, (x + 0.5f) * 512.0f / grid_size, (y + 0.5f) * 512.0f / grid_size));
+    }
+    world.deserialize({{"balls", balls}, {"state", "ONGOING"}}, false);
+
+    std::printf("fill rate: %d balls at %d x %d\n", grid_size * grid_size, target_size, target_size);
+    std::printf("%-16s %8s %10s %10s %10s %10s\n", "shape", "frames", "mean", "p50", "p95", "max");
+
+    for(auto [name, shape]: {std::pair{"triangle", Ball_shape::TRIANGLE}, std::pair{"quad", Ball_shape::QUAD}})
+    {
+        world.set_ball_shape(shape);
+
+        // once untimed, so buffer allocation isn't counted
+        world.render();
+        glFinish();
+
+        Time_histogram frame_times;
+        for(int frame = 0; frame < frames; ++frame)
+        {
+            auto start = std::chrono::steady_clock::now();
+            world.render();
+            glFinish();
+            frame_times.add(static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count()));
+        }
+
+        std::printf("%-16s %8lu %10.3f %10.3f %10.3f %10.3f\n", name, frame_times.get_count(),
+                    frame_times.mean_ms(), frame_times.percentile_ms(0.5f), frame_times.percentile_ms(0.95f), frame_times.max_ms());
+    }
+    std::printf("(ms. percentiles are bucket upper bounds)\n");
+
+    world.set_ball_shape(Ball_shape::QUAD);
+}
+
+// peer 0's final state is drawn with world
+bool run_versus(World & world, const Options & options)
+{
+    constexpr std::uint32_t seed = 2050;
+    constexpr float frame_ms = 1000.0f * Rollback_session::tick_dt;
+
+    Versus_world local_world, remote_world, reference_world;
+    for(auto w: {&local_world, &remote_world, &reference_world})
+        w->start(seed);
+
+    Loopback_link link(options.latency_ms, options.jitter_ms, seed);
+    Rollback_session session0(local_world, link.get_end(0), 0);
+    Rollback_session session1(remote_world, link.get_end(1), 1);
+    std::array<Rollback_session *, 2> sessions {&session0, &session1};
+
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> fling_dist(-1.0f, 1.0f);
+    std::uniform_int_distribution<int> percent(0, 99);
+
+    // inputs as each session accepted them, by the tick they take effect on. This is what the reference world replays
+    std::vector<std::array<Player_input, 2>> script;
+    std::array<Player_input, 2> pending;
+    std::uint32_t checked = 0; // ticks compared so far
+
+    auto ticks = static_cast<std::uint32_t>(options.versus_seconds / Rollback_session::tick_dt);
+    for(std::uint32_t frame = 0; ; ++frame)
+    {
+        bool playing = frame < ticks;
+        if(!playing && session0.get_confirmed_tick() >= ticks && session1.get_confirmed_tick() >= ticks)
+            break;
+
+        link.advance(frame_ms);
+        for(std::size_t player = 0; player < 2; ++player)
+        {
+            // peers occasionally miss a frame, so they drift apart and have to predict
+            if(percent(rng) < 5)
+                continue;
+
+            if(playing && !pending[player].has_fling() && percent(rng) < 3)
+                pending[player] = Player_input::fling(fling_dist(rng), fling_dist(rng));
+
+            auto input_tick = sessions[player]->get_tick() + Rollback_session::input_delay;
+            if(sessions[player]->advance(pending[player]))
+            {
+                if(std::size(script) <= input_tick)
+                    script.resize(input_tick + 1);
+                script[input_tick][player] = pending[player];
+                pending[player] = {};
+            }
+        }
+
+        // both peers and the reference must agree on every tick both peers have confirmed
+        auto confirmed = std::min(std::min(session0.get_confirmed_tick(), session1.get_confirmed_tick()), std::min(session0.get_tick(), session1.get_tick()));
+        for(; checked < confirmed; ++checked)
+        {
+            Versus_world::Snapshot reference;
+            reference_world.save_snapshot(reference);
+            auto reference_checksum = reference.checksum();
+            auto checksum0 = session0.get_checksum(checked), checksum1 = session1.get_checksum(checked);
+            if(!checksum0 || !checksum1 || *checksum0 != reference_checksum || *checksum1 != reference_checksum)
+            {
+                std::printf("desync at tick %u\n", checked);
+                return false;
+            }
+
+            Rollback_session::step(reference_world, checked < std::size(script) ? script[checked] : std::array<Player_input, 2>{});
+        }
+    }
+
+    std::printf("versus: %.1f s, %.0f ms latency, %.0f ms jitter. %u ticks in sync\n", options.versus_seconds, options.latency_ms, options.jitter_ms, checked);
+    std::printf("%-8s %8s %8s %8s %10s %10s %10s %12s %12s\n", "peer", "ticks", "stalls", "mispred", "rollbacks", "resim / rb", "max rb", "rb p50 (ms)", "rb max (ms)");
+    for(std::size_t player = 0; player < 2; ++player)
+    {
+        auto & stats = sessions[player]->get_stats();
+        std::printf("%-8zu %8lu %8lu %8lu %10lu %10.1f %10u %12.3f %12.3f\n", player, stats.ticks, stats.stalls, stats.mispredictions, stats.rollbacks,
+                    stats.rollbacks > 0 ? static_cast<float>(stats.resimulated_ticks) / static_cast<float>(stats.rollbacks) : 0.0f,
+                    stats.max_rollback, stats.rollback_time.percentile_ms(0.5f), stats.rollback_time.max_ms());
+    }
+    auto & scores = local_world.get_player_scores();
+    std::printf("scores: %d - %d\n", scores[0], scores[1]);
+
+    constexpr GLsizei width = 1080, height = 1920;
+    Render_target target(width, height);
+    world.resize(width, height);
+    world.deserialize(local_world.serialize(), false);
+    world.render();
+    write_ppm(options.out_dir + "/versus.ppm", read_pixels(width, height));
+
+    return true;
+}
+
+// a sandbox small enough to fill up quickly, so balls are constantly being spawned into the gaps merges leave. Alongside it, a
+// normal game in gravity mode, fed from a recorded accelerometer trace on a simulated clock, is set up over and over to win
+// or lose, so game_win, game_over and achievement events are posted through Event_dispatcher from the physics tick
+bool run_alloc_check(AAssetManager & assets, const Options & options, int gl_version)
+{
+    constexpr GLsizei width = 1080, height = 1920;
+    constexpr float warmup_seconds = 10.0f;
+
+    Sandbox_config sandbox;
+    sandbox.enabled = true;
+    sandbox.arena_size = 1024.0f;
+    sandbox.spawn_rate = 200.0f;
+    sandbox.max_balls = 800;
+
+    World world(&assets, false, sandbox);
+    world.init(gl_version >= 3, options.out_dir + "/shader_cache");
+    Render_target target(width, height);
+    world.resize(width, height);
+    world.set_pressure_overlay(true);
+
+    // on GL ES 2, big balls switch from point sprites to triangles. Warm that pass up too, on each ball_stream region,
+    // so the driver compiling it later isn't counted
+    world.deserialize({{"balls", {make_ball(20, 512.0f, 512.0f)}}}, false);
+    for(int frame = 0; frame < 10; ++frame)
+        world.render();
+    world.deserialize({{"balls", nlohmann::json::array()}}, false);
+    world.fling(0.0f, 1.0f);
+
+    constexpr std::int64_t step_ns = 10'000'000;
+    std::int64_t now = 0;
+    auto source = std::make_unique<Trace_source>(HEADLESS_GRAVITY_TRACE, [&now]() { return now; });
+    auto trace = source.get();
+    Gravity_stage gravity(std::move(source), Rotation::ROTATION_0);
+    gravity.enable();
+
+    // two size 10 balls about to merge make a 2048 ball, for an achievement and then a win. A compression history that's
+    // already over the limit loses on the next step
+    World game(&assets, true);
+    const std::array<nlohmann::json, 2> rounds
+    {{
+        {{"balls", {make_ball(10, 150.0f, 256.0f), make_ball(10, 345.0f, 256.0f)}}, {"state", "ONGOING"}, {"next_achievement_size", 11},
+         {"last_compressions", std::vector<float>(100, 0.0f)}},
+        {{"balls", {make_ball(1, 100.0f, 100.0f), make_ball(2, 400.0f, 400.0f)}}, {"state", "ONGOING"},
+         {"last_compressions", std::vector<float>(100, 20.0f)}}
+    }};
+    game.deserialize(rounds[0], false);
+    std::size_t next_round = 1;
+    jni_stub::start_dispatcher();
+
+    struct Counts
+    {
+        unsigned long calls = 0;
+        unsigned long allocating_calls = 0;
+        std::uint64_t allocations = 0;
+    };
+    Counts physics_counts, render_counts, gravity_counts, game_counts;
+    auto count = [](Counts & counts, auto && f)
+    {
+        auto before = alloc_count::get();
+        f();
+        auto allocations = alloc_count::get() - before;
+        ++counts.calls;
+        counts.allocations += allocations;
+        counts.allocating_calls += allocations > 0;
+    };
+
+    // 100 Hz physics against 60 fps rendering
+    auto frames = static_cast<int>((warmup_seconds + options.alloc_check_seconds) * 60.0f);
+    auto warmup_frames = static_cast<int>(warmup_seconds * 60.0f);
+    auto warmup_allocs = alloc_count::get();
+    unsigned long checked_events = 0;
+    float physics_time = 0.0f;
+    for(int frame = 0; frame < frames; ++frame)
+    {
+        if(frame == warmup_frames)
+        {
+            warmup_allocs = alloc_count::get() - warmup_allocs;
+            checked_events = get_posted_event_count();
+        }
+
+        bool checked = frame >= warmup_frames;
+        Counts ignored;
+        for(physics_time += 1.0f / 60.0f; physics_time >= 0.01f; physics_time -= 0.01f)
+        {
+            // starting over isn't part of the physics tick, so it isn't counted
+            now += step_ns;
+            if(trace->finished())
+                trace->restart();
+            if(game.is_idle())
+            {
+                game.deserialize(rounds[next_round], false);
+                game.unpause();
+                next_round = (next_round + 1) % std::size(rounds);
+            }
+
+            glm::vec2 grav;
+            count(checked ? gravity_counts : ignored, [&]{ gravity.update(); grav = gravity.get(now - step_ns); });
+            count(checked ? game_counts : ignored, [&]{ game.physics_step(0.01f, grav); });
+            count(checked ? physics_counts : ignored, [&]{ world.physics_step(0.01f, {0.0f, -1.0f}); });
+        }
+        count(checked ? render_counts : ignored, [&]{ world.render(); });
+    }
+    glFinish();
+    checked_events = get_posted_event_count() - checked_events;
+    jni_stub::stop_dispatcher();
+
+    std::printf("alloc check: %.0f s warmup (%llu allocations), then %.0f s checked. %lu game events posted while checked\n", warmup_seconds,
+                static_cast<unsigned long long>(warmup_allocs), options.alloc_check_seconds, checked_events);
+    std::printf("%-14s %8s %12s %12s\n", "", "calls", "allocating", "allocations");
+    bool passed = checked_events > 0;
+    for(auto [name, counts]: {std::pair{"physics_step", physics_counts}, std::pair{"render", render_counts},
+                              std::pair{"gravity", gravity_counts}, std::pair{"game physics", game_counts}})
+    {
+        std::printf("%-14s %8lu %12lu %12llu\n", name, counts.calls, counts.allocating_calls,
+                    static_cast<unsigned long long>(counts.allocations));
+        passed = passed && counts.allocations == 0;
+    }
+
+    world.log_render_stats();
+    world.destroy();
+
+    return passed;
+}
+
+// one thread writes UI data through a Seqlock as fast as it can while others read it, as MainActivity does. Every
+// written value's fields are derived from one counter, so a read mixing two writes is caught
+bool run_seqlock_check(float seconds)
+{
+    constexpr int num_readers = 3;
+    auto make_data = [](int n)
+    {
+        return World::UI_data{n, n ^ 0x5a5a5a5a, static_cast<float>(n & 0xffffff), -n};
+    };
+
+    Seqlock<World::UI_data> ui_data(make_data(0));
+    std::atomic<bool> running = true;
+
+    struct Reader_counts
+    {
+        unsigned long reads = 0;
+        unsigned long retries = 0;
+        unsigned long torn = 0;
+        unsigned long backwards = 0;
+    };
+    std::vector<Reader_counts> reader_counts(num_readers);
+
+    std::vector<std::thread> readers;
+    for(auto & counts: reader_counts)
+    {
+        readers.emplace_back([&ui_data, &running, &make_data, &counts]()
+        {
+            int last_score = 0;
+            World::UI_data data;
+            while(running)
+            {
+                if(!ui_data.try_read(data))
+                {
+                    ++counts.retries;
+                    continue;
+                }
+                ++counts.reads;
+
+                auto expected = make_data(data.score);
+                if(data.high_score != expected.high_score || data.grav_angle != expected.grav_angle || data.pressure != expected.pressure)
+                    ++counts.torn;
+                // the counter wraps at 2^30
+                if(data.score < last_score && last_score - data.score < (1 << 29))
+                    ++counts.backwards;
+                last_score = data.score;
+            }
+        });
+    }
+
+    auto end_time = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<float>(seconds));
+    unsigned long writes = 0;
+    for(int n = 1; std::chrono::steady_clock::now() < end_time; n = (n + 1) & 0x3fffffff)
+    {
+        ui_data.write(make_data(n));
+        ++writes;
+    }
+
+    running = false;
+    for(auto & reader: readers)
+        reader.join();
+
+    std::printf("seqlock check: %.0f s, %lu writes\n", seconds, writes);
+    std::printf("%-8s %12s %12s %8s %10s\n", "reader", "reads", "retries", "torn", "backwards");
+    bool passed = true;
+    for(std::size_t i = 0; i < std::size(reader_counts); ++i)
+    {
+        auto & counts = reader_counts[i];
+        std::printf("%-8zu %12lu %12lu %8lu %10lu\n", i, counts.reads, counts.retries, counts.torn, counts.backwards);
+        passed = passed && counts.reads > 0 && counts.torn == 0 && counts.backwards == 0;
+    }
+    return passed;
+}
+
+// plays a recorded accelerometer trace through Trace_source and Gravity_stage on a simulated clock, sampling gravity at
+// 100 Hz the way Engine::physics_loop does. Plays it twice, and fails if the runs differ. Each step is written to
+// gravity_trace.csv in the output directory
+bool run_gravity_trace(const Options & options)
+{
+    constexpr std::int64_t step_ns = 10'000'000;
+    constexpr std::int64_t sample_lag_ns = 10'000'000; // Engine samples one sensor period in the past
+
+    struct Step
+    {
+        std::int64_t time;
+        glm::vec2 vec;
+    };
+
+    auto replay = [&options]()
+    {
+        std::int64_t now = 0;
+        auto source = std::make_unique<Trace_source>(options.gravity_trace_path, [&now]() { return now; });
+        auto trace = source.get();
+
+        std::vector<Step> steps;
+        if(trace->empty())
+            return steps;
+
+        Gravity_stage gravity(std::move(source), Rotation::ROTATION_0);
+        gravity.enable();
+        while(!trace->finished())
+        {
+            now += step_ns;
+            gravity.update();
+            steps.push_back({now, gravity.get(now - sample_lag_ns)});
+        }
+        return steps;
+    };
+
+    auto steps = replay();
+    if(std::empty(steps))
+    {
+        std::cerr << "no samples in gravity trace " << options.gravity_trace_path << '\n';
+        return false;
+    }
+
+    auto again = replay();
+    auto same = std::size(steps) == std::size(again) && std::equal(std::begin(steps), std::end(steps), std::begin(again),
+        [](const Step & a, const Step & b) { return a.time == b.time && a.vec == b.vec; });
+
+    auto csv_path = options.out_dir + "/gravity_trace.csv";
+    auto csv = std::fopen(csv_path.c_str(), "w");
+    if(csv)
+        std::fputs("time_ms,x,y,angle_deg\n", csv);
+
+    // how smoothly the direction of gravity changes from one physics step to the next
+    constexpr float deg = 180.0f / 3.14159265f;
+    float max_change = 0.0f, sum_sq_change = 0.0f;
+    for(std::size_t i = 0; i < std::size(steps); ++i)
+    {
+        auto angle = std::atan2(steps[i].vec.x, -steps[i].vec.y);
+        if(csv)
+            std::fprintf(csv, "%.0f,%.4f,%.4f,%.2f\n", 1.0e-6 * static_cast<double>(steps[i].time), steps[i].vec.x, steps[i].vec.y, angle * deg);
+
+        if(i > 0)
+        {
+            auto change = std::abs(angle - std::atan2(steps[i - 1].vec.x, -steps[i - 1].vec.y));
+            change = std::min(change, 2.0f * 3.14159265f - change) * deg;
+            max_change = std::max(max_change, change);
+            sum_sq_change += change * change;
+        }
+    }
+    if(csv)
+        std::fclose(csv);
+
+    std::printf("gravity trace: %zu steps over %.2f s, replay %s\n", std::size(steps), 1.0e-9 * static_cast<double>(steps.back().time),
+                same ? "identical" : "DIFFERS");
+    std::printf("angle change / step: rms %.2f deg, max %.2f deg. final gravity (%.3f, %.3f)\n",
+                std::sqrt(sum_sq_change / static_cast<float>(std::max<std::size_t>(std::size(steps) - 1, 1))), max_change,
+                steps.back().vec.x, steps.back().vec.y);
+    if(csv)
+        std::printf("wrote %s\n", csv_path.c_str());
+
+    return same;
+}
+
+// plays normal games at 100 Hz, as Engine::physics_loop does, flinging every 50 ms. Runs once with game_win, game_over and
+// achievement called on the physics thread, as before Event_dispatcher, then once through it, and reports physics step
+// times split by whether the step made a call. The calls are stubs that spin for jni_call_us, 0 by default. So this
+// measures what the dispatcher itself adds to a step, not what a real JNI call costs, which needs a device
+void run_event_latency(World & world, const Options & options)
+{
+    constexpr auto step_time = std::chrono::milliseconds(10);
+    constexpr int fling_steps = 5;
+
+    world.resize(1080, 1920);
+    jni_stub::set_call_time(std::chrono::microseconds(options.jni_call_us));
+
+    std::printf("event latency: %.0f s per run. JNI calls are stubs that spin for %d us, not real calls\n", options.event_latency_seconds, options.jni_call_us);
+    std::printf("%-12s %-16s %8s %10s %10s %10s\n", "", "", "count", "mean", "p99", "max");
+
+    for(auto dispatched: {false, true})
+    {
+        if(dispatched)
+            jni_stub::start_dispatcher();
+
+        Time_histogram physics_ticks, event_ticks;
+        std::mt19937 rng(2050);
+        std::uniform_real_distribution<float> fling_dist(-1.0f, 1.0f);
+
+        // achievements are only made once per save, so start each game from a fresh one
+        auto restart = [&world]()
+        {
+            world.deserialize({{"high_score", 0}, {"next_achievement_size", 3}}, false);
+            world.new_game();
+        };
+        restart();
+
+        auto end_time = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<float>(options.event_latency_seconds));
+        int step = 0;
+        for(auto next = std::chrono::steady_clock::now(); next < end_time; next += step_time, ++step)
+        {
+            // carry on after a win, and start over after a loss, as a player would
+            if(world.is_paused())
+                world.unpause();
+            else if(world.is_idle())
+                restart();
+
+            if(step % fling_steps == 0)
+            {
+                auto x = fling_dist(rng), y = fling_dist(rng);
+                world.fling(x, y);
+            }
+
+            auto events_posted = get_posted_event_count();
+            auto step_start_time = std::chrono::steady_clock::now();
+
+            world.physics_step(0.01f, {0.0f, -1.0f});
+
+            auto step_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - step_start_time).count();
+            (get_posted_event_count() != events_posted ? event_ticks : physics_ticks).add(static_cast<std::uint64_t>(step_ns));
+
+            std::this_thread::sleep_until(next + step_time);
+        }
+
+        if(dispatched)
+            jni_stub::stop_dispatcher();
+
+        for(auto [name, hist]: {std::pair{"steps", &physics_ticks}, std::pair{"steps w/ events", &event_ticks}})
+        {
+            std::printf("%-12s %-16s %8lu %10.3f %10.3f %10.3f\n", dispatched ? "dispatcher" : "synchronous", name, hist->get_count(),
+                        hist->mean_ms(), hist->percentile_ms(0.99f), hist->max_ms());
+        }
+    }
+    std::printf("(ms. percentiles are bucket upper bounds)\n");
+}
+
+// each case is a set of durations, and the range its p50 must land in. Percentiles are reported as bucket upper edges, so
+// p50 can't be under the true median, and must never be over the max
+bool run_histogram_check()
+{
+    constexpr std::uint64_t ms = 1'000'000;
+    constexpr std::uint64_t last_bucket_start = std::uint64_t{1} << (Time_histogram::min_shift + Time_histogram::num_buckets - 2);
+
+    struct Case
+    {
+        const char * name;
+        std::vector<std::uint64_t> ns;
+        float min_p50_ms, max_p50_ms;
+    };
+    const Case cases[] =
+    {
+        {"under 1 us",      {100, 200, 300},                        0.0f,    0.001024f},
+        {"in range",        {3 * ms, 3 * ms, 5 * ms},               3.0f,    4.194304f},
+        {"past top edge",   {1427 * ms, 1500 * ms, 1612 * ms},      1500.0f, 1612.0f},
+        {"mixed",           {1 * ms, 1400 * ms, 1600 * ms},         1400.0f, 1600.0f},
+        {"last bucket",     {last_bucket_start, last_bucket_start}, 67.0f,   67.2f},
+    };
+
+    std::printf("%-16s %10s %10s %10s %10s %10s\n", "case", "mean", "p50", "p95", "max", "");
+    bool passed = true;
+    for(auto & c: cases)
+    {
+        Time_histogram hist;
+        for(auto ns: c.ns)
+            hist.add(ns);
+
+        auto p50 = hist.percentile_ms(0.5f), p95 = hist.percentile_ms(0.95f), max = hist.max_ms();
+        auto ok = p50 >= c.min_p50_ms && p50 <= c.max_p50_ms && p50 <= p95 && p95 <= max;
+        std::printf("%-16s %10.3f %10.3f %10.3f %10.3f %10s\n", c.name, hist.mean_ms(), p50, p95, max, ok ? "ok" : "FAIL");
+        passed = passed && ok;
+    }
+    return passed;
+}
+
+bool parse_args(int argc, char * argv[], Options & options)
+{
+    for(int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if(arg == "--gles2")
+            options.gles2 = true;
+        else if(arg == "--pressure")
+            options.pressure = true;
+        else if(arg == "--fill-rate")
+            options.fill_rate = true;
+        else if(arg == "--histogram-check")
+            options.histogram_check = true;
+        else if(arg == "--update-golden")
+            options.update_golden = true;
+        else if(arg == "--frames" && i + 1 < argc)
+            options.frames = std::max(1, std::stoi(argv[++i]));
+        else if(arg == "--out" && i + 1 < argc)
+            options.out_dir = argv[++i];
+        else if(arg == "--golden" && i + 1 < argc)
+            options.golden_dir = argv[++i];
+        else if(arg == "--trace" && i + 1 < argc)
+            options.trace_path = argv[++i];
+        else if(arg == "--log" && i + 1 < argc)
+            options.log_path = argv[++i];
+        else if(arg == "--stress" && i + 1 < argc)
+            options.stress_seconds = std::stof(argv[++i]);
+        else if(arg == "--sandbox" && i + 1 < argc)
+            options.sandbox_balls = static_cast<std::size_t>(std::max(1, std::stoi(argv[++i])));
+        else if(arg == "--versus" && i + 1 < argc)
+            options.versus_seconds = std::stof(argv[++i]);
+        else if(arg == "--latency" && i + 1 < argc)
+            options.latency_ms = std::stof(argv[++i]);
+        else if(arg == "--jitter" && i + 1 < argc)
+            options.jitter_ms = std::stof(argv[++i]);
+        else if(arg == "--alloc-check" && i + 1 < argc)
+            options.alloc_check_seconds = std::stof(argv[++i]);
+        else if(arg == "--gravity-trace" && i + 1 < argc)
+            options.gravity_trace_path = argv[++i];
+        else if(arg == "--seqlock-check" && i + 1 < argc)
+            options.seqlock_check_seconds = std::stof(argv[++i]);
+        else if(arg == "--event-latency" && i + 1 < argc)
+            options.event_latency_seconds = std::stof(argv[++i]);
+        else if(arg == "--jni-call-us" && i + 1 < argc)
+            options.jni_call_us = std::max(0, std::stoi(argv[++i]));
+        else
+            return false;
+    }
+    return !options.update_golden || !std::empty(options.golden_dir);
+}
+
+int main(int argc, char * argv[])
+{
+    Options options;
+    if(!parse_args(argc, argv, options))
+    {
+        std::cerr << "usage: " << argv[0] << " [--gles2] [--frames N] [--out DIR] [--golden DIR] [--update-golden] [--trace FILE] [--stress SECONDS] [--sandbox BALLS]\n"
+                  << "       [--versus SECONDS] [--latency MS] [--jitter MS] [--pressure] [--alloc-check SECONDS] [--seqlock-check SECONDS] [--gravity-trace FILE]\n"
+                  << "       [--event-latency SECONDS] [--jni-call-us US] [--fill-rate] [--histogram-check] [--log FILE]\n";
+        return EXIT_FAILURE;
+    }
+
+    TRACE_THREAD_NAME("render");
+
+    if(!std::empty(options.log_path) && !log_ring::log_to_file(options.log_path))
+        std::cerr << "could not open log file " << options.log_path << '\n';
+
+    mkdir(options.out_dir.c_str(), 0755);
+    if(options.update_golden)
+        mkdir(options.golden_dir.c_str(), 0755);
+
+    int gl_version = options.gles2 ? 2 : 3;
+    bool passed = true;
+
+    try
+    {
+        Offscreen_context context(gl_version);
+
+        AAssetManager assets{{HEADLESS_ASSET_DIR, HEADLESS_GENERATED_ASSET_DIR}};
+        Sandbox_config sandbox;
+        sandbox.enabled = options.sandbox_balls > 0;
+        sandbox.arena_size = sandbox_arena_size;
+        sandbox.spawn_rate = 0.0f;
+        sandbox.max_balls = options.sandbox_balls;
+
+        World world(&assets, false, sandbox);
+        world.init(gl_version >= 3, options.out_dir + "/shader_cache");
+        world.set_pressure_overlay(options.pressure);
+
+        if(options.histogram_check)
+            passed = run_histogram_check();
+        else if(!std::empty(options.gravity_trace_path))
+            passed = run_gravity_trace(options);
+        else if(options.seqlock_check_seconds > 0.0f)
+            passed = run_seqlock_check(options.seqlock_check_seconds);
+        else if(options.event_latency_seconds > 0.0f)
+            run_event_latency(world, options);
+        else if(options.alloc_check_seconds > 0.0f)
+            passed = run_alloc_check(assets, options, gl_version);
+        else if(options.versus_seconds > 0.0f)
+            passed = run_versus(world, options);
+        else if(sandbox.enabled)
+            run_sandbox(world, options.sandbox_balls, options.frames, options.out_dir);
+        else if(options.fill_rate)
+            run_fill_rate(world, options.frames);
+        else if(options.stress_seconds > 0.0f)
+            passed = run_stress(assets, options, gl_version);
+        else
+            passed = run_scenes(world, options, gl_version);
+
+        world.log_render_stats();
+        world.destroy();
+        log_ring::flush();
+    }
+    catch(std::exception & e)
+    {
+        log_ring::flush();
+        std::cerr << "error: " << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    if(!std::empty(options.trace_path))
+    {
+#ifdef ENABLE_TRACING
+        if(!trace::write_chrome_json(options.trace_path))
+            std::cerr << "could not write trace to " << options.trace_path << '\n';
+#else
+        std::cerr << "built without tracing. Reconfigure with -DTRACING=ON to use --trace\n";
+#endif
+    }
+
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
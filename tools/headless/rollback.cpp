@@ -0,0 +1,181 @@
+// Copyright 2022 Matthew Chandler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "rollback.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "trace.hpp"
+
+Player_input Player_input::fling(float x, float y)
+{
+    auto length = std::sqrt(x * x + y * y);
+    if(length == 0.0f)
+        return {};
+
+    // unit direction in 1 / 16384ths. One component is always at least ~0.7, so this never rounds to no fling
+    auto quantize = [length](float v) { return static_cast<std::int16_t>(std::lround(v / length * 16384.0f)); };
+    return {quantize(x), quantize(y)};
+}
+
+Loopback_link::Loopback_link(float latency_ms, float jitter_ms, std::uint32_t seed):
+    latency_ms(latency_ms),
+    jitter_ms(jitter_ms),
+    rng(seed),
+    ends{{{*this, 0}, {*this, 1}}}
+{}
+
+void Loopback_link::End::send(const Input_packet & packet)
+{
+    auto jitter = std::uniform_real_distribution<float>(-link.jitter_ms, link.jitter_ms)(link.rng);
+    link.in_flight[static_cast<std::size_t>(1 - player)].push_back({link.now_ms + std::max(link.latency_ms + jitter, 0.0f), packet});
+}
+
+std::optional<Input_packet> Loopback_link::End::receive()
+{
+    // jitter can reorder packets, so take whichever arrived first
+    auto & queue = link.in_flight[static_cast<std::size_t>(player)];
+    auto next = std::min_element(std::begin(queue), std::end(queue), [](const In_flight & a, const In_flight & b) { return a.arrival_ms < b.arrival_ms; });
+    if(next == std::end(queue) || next->arrival_ms > link.now_ms)
+        return std::nullopt;
+
+    auto packet = next->packet;
+    queue.erase(next);
+    return packet;
+}
+
+Rollback_session::Rollback_session(Versus_world & world, Transport & transport, int local_player):
+    world(world),
+    transport(transport),
+    local_player(local_player)
+{
+    // nobody has input for the first input_delay ticks
+    for(std::uint32_t t = 0; t < input_delay; ++t)
+        get_inputs(t).remote_received = true;
+    confirmed = input_delay;
+}
+
+Rollback_session::Tick_inputs & Rollback_session::get_inputs(std::uint32_t t)
+{
+    auto & entry = inputs[t % std::size(inputs)];
+    if(entry.tick != t)
+        entry = {t};
+    return entry;
+}
+
+void Rollback_session::step(Versus_world & world, const std::array<Player_input, 2> & inputs)
+{
+    // in player order, so every peer spawns the balls in the same order
+    for(int player = 0; player < 2; ++player)
+    {
+        auto & input = inputs[static_cast<std::size_t>(player)];
+        if(input.has_fling())
+            world.fling(player, input.fling_x, input.fling_y);
+    }
+    world.physics_step(tick_dt);
+}
+
+void Rollback_session::simulate(std::uint32_t t)
+{
+    world.save_snapshot(snapshots[t % std::size(snapshots)]);
+
+    // remote input that hasn't arrived is predicted to be nothing. Flings are rare, one tick events, so that's the likeliest guess
+    auto & entry = get_inputs(t);
+    std::array<Player_input, 2> player_inputs;
+    player_inputs[static_cast<std::size_t>(local_player)] = entry.local;
+    player_inputs[static_cast<std::size_t>(1 - local_player)] = entry.remote;
+    step(world, player_inputs);
+}
+
+void Rollback_session::poll()
+{
+    auto rollback_to = tick;
+    while(auto packet = transport.receive())
+    {
+        auto & entry = get_inputs(packet->tick);
+        if(packet->tick < tick && entry.remote != packet->input)
+        {
+            ++stats.mispredictions;
+            rollback_to = std::min(rollback_to, packet->tick);
+        }
+        entry.remote = packet->input;
+        entry.remote_received = true;
+    }
+
+    while(get_inputs(confirmed).remote_received)
+        ++confirmed;
+
+    if(rollback_to < tick)
+    {
+        TRACE_SCOPE("rollback");
+        auto start = std::chrono::steady_clock::now();
+
+        world.restore_snapshot(snapshots[rollback_to % std::size(snapshots)]);
+        for(auto t = rollback_to; t < tick; ++t)
+            simulate(t);
+
+        ++stats.rollbacks;
+        stats.resimulated_ticks += tick - rollback_to;
+        stats.max_rollback = std::max(stats.max_rollback, tick - rollback_to);
+        stats.rollback_time.add(static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count()));
+    }
+
+    record_checksums();
+}
+
+void Rollback_session::record_checksums()
+{
+    // every state up to the confirmed tick is final
+    for(; next_checksum <= confirmed && next_checksum < tick; ++next_checksum)
+        checksums[next_checksum % std::size(checksums)] = {next_checksum, snapshots[next_checksum % std::size(snapshots)].checksum()};
+}
+
+bool Rollback_session::advance(const Player_input & local_input)
+{
+    poll();
+
+    if(tick >= confirmed + max_prediction)
+    {
+        ++stats.stalls;
+        return false;
+    }
+
+    auto input_tick = tick + input_delay;
+    get_inputs(input_tick).local = local_input;
+    transport.send({input_tick, local_input});
+
+    simulate(tick);
+    ++tick;
+    ++stats.ticks;
+    record_checksums();
+
+    return true;
+}
+
+std::optional<std::uint64_t> Rollback_session::get_checksum(std::uint32_t t) const
+{
+    auto & [checksum_tick, checksum] = checksums[t % std::size(checksums)];
+    if(checksum_tick != t || t >= next_checksum)
+        return std::nullopt;
+    return checksum;
+}
@@ -0,0 +1,174 @@
+// Copyright 2022 Matthew Chandler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef INC_2050_ROLLBACK_HPP
+#define INC_2050_ROLLBACK_HPP
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <random>
+#include <vector>
+
+#include "histogram.hpp"
+#include "versus_world.hpp"
+
+// GGPO-style rollback for versus mode. Each peer runs its own Versus_world, and keeps simulating with a guess for the remote player's
+// input. When the real input for a past tick arrives and differs from the guess, the world is restored to its snapshot from
+// that tick, and everything since is simulated again within the same frame
+// Only headless --versus drives this for now. The app has no versus UI or network transport, so it isn't built into the app
+
+// one player's input for one tick. Flings are the only input. The direction is quantized, so both peers apply exactly the same one
+struct Player_input
+{
+    std::int16_t fling_x = 0, fling_y = 0; // (0, 0) for no fling
+
+    static Player_input fling(float x, float y);
+    bool has_fling() const { return fling_x != 0 || fling_y != 0; }
+    bool operator==(const Player_input & other) const { return fling_x == other.fling_x && fling_y == other.fling_y; }
+    bool operator!=(const Player_input & other) const { return !(*this == other); }
+};
+
+struct Input_packet
+{
+    std::uint32_t tick;
+    Player_input input;
+};
+
+// carries input packets to the other peer. Packets may arrive late or out of order, but must not be lost
+class Transport
+{
+public:
+    virtual ~Transport() = default;
+    virtual void send(const Input_packet & packet) = 0;
+    virtual std::optional<Input_packet> receive() = 0; // next packet that has arrived, if any
+};
+
+// in-process link between two peers, with simulated latency and jitter. Time only moves when advance is called, so runs are
+// repeatable for a given seed. Not thread safe: drive both peers from one thread
+class Loopback_link
+{
+private:
+    class End: public Transport
+    {
+    private:
+        Loopback_link & link;
+        int player;
+    public:
+        End(Loopback_link & link, int player): link(link), player(player) {}
+        void send(const Input_packet & packet) override;
+        std::optional<Input_packet> receive() override;
+    };
+
+    struct In_flight
+    {
+        float arrival_ms;
+        Input_packet packet;
+    };
+
+    float latency_ms;
+    float jitter_ms;
+    float now_ms = 0.0f;
+    std::minstd_rand rng;
+    std::array<End, 2> ends;
+    std::array<std::vector<In_flight>, 2> in_flight; // to each player
+
+public:
+    Loopback_link(float latency_ms, float jitter_ms, std::uint32_t seed);
+    Loopback_link(const Loopback_link &) = delete;
+    Loopback_link & operator=(const Loopback_link &) = delete;
+
+    Transport & get_end(int player) { return ends[static_cast<std::size_t>(player)]; }
+    void advance(float ms) { now_ms += ms; }
+};
+
+class Rollback_session
+{
+public:
+    constexpr static float tick_dt = 0.01f; // fixed, so both peers integrate identically
+    constexpr static std::uint32_t input_delay = 2; // ticks before local input takes effect. Hides some latency, so fewer rollbacks
+    constexpr static std::uint32_t max_prediction = 8; // ticks the simulation may get ahead of the remote's input before stalling
+
+    struct Stats
+    {
+        unsigned long ticks = 0;
+        unsigned long stalls = 0; // calls to advance that had to wait for the remote
+        unsigned long mispredictions = 0;
+        unsigned long rollbacks = 0;
+        unsigned long resimulated_ticks = 0;
+        std::uint32_t max_rollback = 0; // most ticks resimulated at once
+        Time_histogram rollback_time; // restoring and resimulating, per rollback
+    };
+
+private:
+    constexpr static std::size_t history_size = 64; // must cover input_delay + max_prediction ticks either side of the current one
+    constexpr static std::size_t checksum_history_size = 256;
+
+    Versus_world & world;
+    Transport & transport;
+    int local_player;
+
+    std::uint32_t tick = 0; // next tick to simulate
+    std::uint32_t confirmed = 0; // the remote's input is known for every tick before this one
+
+    struct Tick_inputs
+    {
+        std::uint32_t tick = UINT32_MAX;
+        Player_input local;
+        Player_input remote; // predicted until received
+        bool remote_received = false;
+    };
+    std::array<Tick_inputs, history_size> inputs;
+    Tick_inputs & get_inputs(std::uint32_t t);
+
+    // snapshots[t % size] holds the state from just before tick t. One spare, so the oldest is still there to checksum once confirmed
+    std::array<Versus_world::Snapshot, max_prediction + 2> snapshots;
+
+    std::array<std::pair<std::uint32_t, std::uint64_t>, checksum_history_size> checksums {};
+    std::uint32_t next_checksum = 0;
+
+    Stats stats;
+
+    void simulate(std::uint32_t t);
+    void poll();
+    void record_checksums();
+
+public:
+    // both peers must start their worlds with Versus_world::start and the same seed
+    Rollback_session(Versus_world & world, Transport & transport, int local_player);
+    Rollback_session(const Rollback_session &) = delete;
+    Rollback_session & operator=(const Rollback_session &) = delete;
+
+    // one tick of versus simulation, as every peer runs it
+    static void step(Versus_world & world, const std::array<Player_input, 2> & inputs);
+
+    // simulate one tick, with local_input taking effect input_delay ticks later. Returns false, without simulating or using
+    // local_input, if too far ahead of the remote. Call it again next frame
+    bool advance(const Player_input & local_input);
+
+    std::uint32_t get_tick() const { return tick; }
+    std::uint32_t get_confirmed_tick() const { return confirmed; }
+    // checksum of the state just before tick t, once it's final (t <= confirmed tick). Only recent ticks are kept
+    std::optional<std::uint64_t> get_checksum(std::uint32_t t) const;
+    const Stats & get_stats() const { return stats; }
+};
+
+#endif //INC_2050_ROLLBACK_HPP
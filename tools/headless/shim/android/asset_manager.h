@@ -0,0 +1,54 @@
+// Copyright 2022 Matthew Chandler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// stand-in for the NDK's asset manager for the headless build. Assets are read from a list of directories
+
+#ifndef INC_2050_HEADLESS_ANDROID_ASSET_MANAGER_H
+#define INC_2050_HEADLESS_ANDROID_ASSET_MANAGER_H
+
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+enum
+{
+    AASSET_MODE_UNKNOWN = 0,
+    AASSET_MODE_RANDOM = 1,
+    AASSET_MODE_STREAMING = 2,
+    AASSET_MODE_BUFFER = 3
+};
+
+struct AAssetManager
+{
+    std::vector<std::string> dirs; // searched in order
+};
+
+struct AAsset
+{
+    std::vector<char> data;
+};
+
+AAsset * AAssetManager_open(AAssetManager * mgr, const char * filename, int mode);
+const void * AAsset_getBuffer(AAsset * asset);
+off_t AAsset_getLength(AAsset * asset);
+void AAsset_close(AAsset * asset);
+
+#endif //INC_2050_HEADLESS_ANDROID_ASSET_MANAGER_H
@@ -0,0 +1,87 @@
+// Copyright 2022 Matthew Chandler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// stand-in for the NDK's logging for the headless build. Everything goes to stderr
+
+#ifndef INC_2050_HEADLESS_ANDROID_LOG_H
+#define INC_2050_HEADLESS_ANDROID_LOG_H
+
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+
+enum android_LogPriority
+{
+    ANDROID_LOG_UNKNOWN = 0,
+    ANDROID_LOG_DEFAULT,
+    ANDROID_LOG_VERBOSE,
+    ANDROID_LOG_DEBUG,
+    ANDROID_LOG_INFO,
+    ANDROID_LOG_WARN,
+    ANDROID_LOG_ERROR,
+    ANDROID_LOG_FATAL,
+    ANDROID_LOG_SILENT,
+};
+
+inline const char * android_log_priority_str(int prio)
+{
+    switch(prio)
+    {
+    case ANDROID_LOG_VERBOSE: return "V";
+    case ANDROID_LOG_DEBUG:   return "D";
+    case ANDROID_LOG_INFO:    return "I";
+    case ANDROID_LOG_WARN:    return "W";
+    case ANDROID_LOG_ERROR:   return "E";
+    case ANDROID_LOG_FATAL:   return "F";
+    default:                  return "?";
+    }
+}
+
+inline int __android_log_write(int prio, const char * tag, const char * text)
+{
+    return std::fprintf(stderr, "%s/%s: %s\n", android_log_priority_str(prio), tag, text);
+}
+
+inline int __android_log_print(int prio, const char * tag, const char * fmt, ...)
+{
+    std::fprintf(stderr, "%s/%s: ", android_log_priority_str(prio), tag);
+    va_list args;
+    va_start(args, fmt);
+    auto ret = std::vfprintf(stderr, fmt, args);
+    va_end(args);
+    std::fputc('\n', stderr);
+    return ret;
+}
+
+[[noreturn]] inline void __android_log_assert(const char * cond, const char * tag, const char * fmt, ...)
+{
+    std::fprintf(stderr, "F/%s: %s\n", tag, cond ? cond : "");
+    if(fmt)
+    {
+        va_list args;
+        va_start(args, fmt);
+        std::vfprintf(stderr, fmt, args);
+        va_end(args);
+        std::fputc('\n', stderr);
+    }
+    std::abort();
+}
+
+#endif //INC_2050_HEADLESS_ANDROID_LOG_H
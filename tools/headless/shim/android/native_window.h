@@ -0,0 +1,36 @@
+// Copyright 2022 Matthew Chandler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+// stand-in for the NDK's native window for the headless build. Nothing is ever drawn to one, so it only has a size
+
+#ifndef INC_2050_HEADLESS_ANDROID_NATIVE_WINDOW_H
+#define INC_2050_HEADLESS_ANDROID_NATIVE_WINDOW_H
+
+#include <cstdint>
+
+struct ANativeWindow
+{
+    std::int32_t width, height;
+};
+
+std::int32_t ANativeWindow_getWidth(ANativeWindow * window);
+std::int32_t ANativeWindow_getHeight(ANativeWindow * window);
+void ANativeWindow_release(ANativeWindow * window); // the caller owns the window, so this does nothing
+
+#endif //INC_2050_HEADLESS_ANDROID_NATIVE_WINDOW_H
@@ -0,0 +1,178 @@
+// Copyright 2022 Matthew Chandler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// headless implementations of the asset manager, native window and the JNI functions World and Engine_core use
+
+#include <android/asset_manager.h>
+#include <android/native_window.h>
+
+#include <atomic>
+#include <fstream>
+#include <iterator>
+#include <regex>
+#include <unordered_map>
+
+#include "event_dispatcher.hpp"
+#include "jni.hpp"
+#include "jni_stub.hpp"
+#include "log.hpp"
+
+AAsset * AAssetManager_open(AAssetManager * mgr, const char * filename, int)
+{
+    for(auto & dir: mgr->dirs)
+    {
+        std::ifstream file(dir + "/" + filename, std::ios::binary);
+        if(file)
+            return new AAsset{{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()}};
+    }
+
+    LOG_ERROR_PRINT("AAssetManager_open", "Could not find asset: %s", filename);
+    return nullptr;
+}
+const void * AAsset_getBuffer(AAsset * asset) { return asset ? std::data(asset->data) : nullptr; }
+off_t AAsset_getLength(AAsset * asset) { return asset ? static_cast<off_t>(std::size(asset->data)) : 0; }
+void AAsset_close(AAsset * asset) { delete asset; }
+
+std::int32_t ANativeWindow_getWidth(ANativeWindow * window) { return window->width; }
+std::int32_t ANativeWindow_getHeight(ANativeWindow * window) { return window->height; }
+void ANativeWindow_release(ANativeWindow *) {}
+
+namespace
+{
+    std::chrono::microseconds call_time {0};
+    bool dispatching = false; // only changed while nothing is calling game_over, etc
+    std::atomic<unsigned long> posted {0};
+
+    void call(const Game_event & event)
+    {
+        auto end_time = std::chrono::steady_clock::now() + call_time;
+        while(std::chrono::steady_clock::now() < end_time)
+            ;
+
+        switch(event.type)
+        {
+        case Game_event::Type::GAME_WIN:    LOG_DEBUG_PRINT("game_win", "score: %d", event.value); break;
+        case Game_event::Type::GAME_OVER:   LOG_DEBUG_PRINT("game_over", "score: %d", event.value); break;
+        case Game_event::Type::ACHIEVEMENT: LOG_DEBUG_PRINT("achievement", "size: %d", event.value); break;
+        }
+    }
+
+    struct Stub_sender
+    {
+        void operator()(const Game_event & event) { call(event); }
+    };
+    Event_dispatcher<Stub_sender> event_dispatcher;
+
+    void post(Game_event::Type type, int value, bool new_high_score = false)
+    {
+        if(dispatching)
+        {
+            event_dispatcher.post(type, value, new_high_score);
+        }
+        else
+        {
+            ++posted;
+            call({type, value, new_high_score});
+        }
+    }
+}
+
+void jni_stub::set_call_time(std::chrono::microseconds time) { call_time = time; }
+void jni_stub::start_dispatcher()
+{
+    event_dispatcher.start();
+    dispatching = true;
+}
+void jni_stub::stop_dispatcher()
+{
+    dispatching = false;
+    event_dispatcher.stop();
+}
+
+void game_over(int score, bool new_high_score) { post(Game_event::Type::GAME_OVER, score, new_high_score); }
+void game_win(int score, bool new_high_score) { post(Game_event::Type::GAME_WIN, score, new_high_score); }
+void achievement(int size) { post(Game_event::Type::ACHIEVEMENT, size); }
+unsigned long get_posted_event_count() { return posted + event_dispatcher.get_posted(); }
+
+namespace
+{
+    // colors and color arrays from the app's colors.xml, as the ARGB ints Android would give us
+    struct Resources
+    {
+        std::unordered_map<std::string, int> colors;
+        std::unordered_map<std::string, std::vector<int>> arrays;
+
+        static int parse_color(const std::string & hex)
+        {
+            auto value = std::stoul(hex, nullptr, 16);
+            if(std::size(hex) <= 6)
+                value |= 0xFF000000u;
+            return static_cast<int>(value);
+        }
+
+        Resources()
+        {
+            std::ifstream file(HEADLESS_RES_DIR "/colors.xml");
+            std::string xml{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+            if(std::empty(xml))
+                LOG_ERROR_WRITE("Resources", "Could not read " HEADLESS_RES_DIR "/colors.xml");
+
+            const std::regex color_re{R"re(<color name="(\w+)"[^>]*>#([0-9A-Fa-f]+)</color>)re"};
+            for(auto i = std::sregex_iterator(std::begin(xml), std::end(xml), color_re); i != std::sregex_iterator(); ++i)
+                colors[(*i)[1]] = parse_color((*i)[2]);
+
+            const std::regex array_re{R"re(<array name="(\w+)"[^>]*>([\s\S]*?)</array>)re"};
+            const std::regex item_re{R"re(<item>#([0-9A-Fa-f]+)</item>)re"};
+            for(auto i = std::sregex_iterator(std::begin(xml), std::end(xml), array_re); i != std::sregex_iterator(); ++i)
+            {
+                auto body = (*i)[2].str();
+                auto & array = arrays[(*i)[1]];
+                for(auto j = std::sregex_iterator(std::begin(body), std::end(body), item_re); j != std::sregex_iterator(); ++j)
+                    array.push_back(parse_color((*j)[1]));
+            }
+        }
+    };
+
+    const Resources & get_resources()
+    {
+        static const Resources resources;
+        return resources;
+    }
+}
+
+int get_res_color(const std::string & id)
+{
+    auto & colors = get_resources().colors;
+    if(auto color = colors.find(id); color != std::end(colors))
+        return color->second;
+
+    LOG_ERROR_PRINT("get_res_color", "Could not find resource color: %s", id.c_str());
+    return {};
+}
+
+std::vector<int> get_res_int_array(const std::string & id)
+{
+    auto & arrays = get_resources().arrays;
+    if(auto array = arrays.find(id); array != std::end(arrays))
+        return array->second;
+
+    LOG_ERROR_PRINT("get_res_int_array", "Could not find resource array: %s", id.c_str());
+    return {};
+}
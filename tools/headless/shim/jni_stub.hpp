@@ -0,0 +1,36 @@
+// Copyright 2022 Matthew Chandler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef INC_2050_JNI_STUB_HPP
+#define INC_2050_JNI_STUB_HPP
+
+#include <chrono>
+
+// controls the headless stand-ins for jni.hpp's game_win, game_over and achievement. By default they're made on the caller's
+// thread, as the app did before Event_dispatcher, and only log. Each call can also be made to take call_time, spinning to
+// stand in for attaching to the JVM and calling into Kotlin
+namespace jni_stub
+{
+    void set_call_time(std::chrono::microseconds call_time);
+    void start_dispatcher(); // queue calls, and make them from an Event_dispatcher thread, as the app does
+    void stop_dispatcher(); // sends anything still queued, then goes back to calling on the caller's thread
+}
+
+#endif //INC_2050_JNI_STUB_HPP
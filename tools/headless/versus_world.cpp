@@ -0,0 +1,192 @@
+// Copyright 2022 Matthew Chandler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "versus_world.hpp"
+
+#include "color.hpp"
+#include "jni.hpp"
+#include "trace.hpp"
+
+Versus_world::Versus_world()
+{
+    for(auto & color: get_res_int_array("ball_colors"))
+        ball_colors.emplace_back(color_int_to_vec(color));
+
+    for(std::size_t i = 0; i < initial_ball_pool; ++i)
+        free_balls.push_back({Ball(ball_colors, 1, {}, {}), 0});
+}
+
+void Versus_world::add_ball(const Player_ball & ball)
+{
+    if(std::empty(free_balls))
+        free_balls.push_back(ball);
+    else
+        free_balls.front() = ball;
+
+    balls.splice(std::end(balls), free_balls, std::begin(free_balls));
+}
+
+void Versus_world::remove_ball(std::list<Player_ball>::iterator ball)
+{
+    free_balls.splice(std::begin(free_balls), balls, ball);
+}
+
+void Versus_world::start(std::uint32_t seed)
+{
+    while(!std::empty(balls))
+        remove_ball(std::begin(balls));
+
+    rng.seed(seed);
+    player_grav = {};
+    player_scores = {};
+    winner = -1;
+
+    for(int player = 0; player < 2; ++player)
+    {
+        for(std::size_t i = 0; i < num_starting_balls; ++i)
+            spawn_ball(player);
+    }
+}
+
+void Versus_world::spawn_ball(int player)
+{
+    // drawn one at a time, so the order doesn't depend on argument evaluation order
+    auto size = std::uniform_int_distribution(1, 2)(rng);
+    std::uniform_real_distribution<float> pos_dist(0.0f, win_size);
+    auto x = pos_dist(rng);
+    auto y = pos_dist(rng);
+    std::uniform_real_distribution<float> vel_dist(-7.0f, 7.0f);
+    auto vel_x = vel_dist(rng);
+    auto vel_y = vel_dist(rng);
+
+    add_ball({Ball(ball_colors, size, glm::vec2{x, y}, glm::vec2{vel_x, vel_y}), player});
+}
+
+void Versus_world::physics_step(float dt)
+{
+    if(winner >= 0)
+        return;
+
+    TRACE_SCOPE("Versus_world::physics_step");
+
+    for(auto & b: balls)
+    {
+        if(winner < 0 && b.ball.get_size() >= 11) // 2^11 = 2048
+            winner = b.player;
+
+        b.ball.physics_step(dt, win_size, player_grav[static_cast<std::size_t>(b.player)], wall_damp);
+    }
+
+    // every pair, as the normal game does. Different players' balls bounce off each other even when they're the same size.
+    // The earlier ball in the list is the one that survives a merge
+    for(auto a = std::begin(balls); a != std::end(balls); ++a)
+    {
+        for(auto b = std::next(a); b != std::end(balls);)
+        {
+            auto collision = a->player == b->player ? collide_balls(a->ball, b->ball, e) : bounce_balls(a->ball, b->ball, e);
+            if(collision.merged)
+            {
+                player_scores[static_cast<std::size_t>(a->player)] += 1 << a->ball.get_size();
+                remove_ball(b++);
+                continue;
+            }
+            ++b;
+        }
+    }
+}
+
+void Versus_world::fling(int player, float x, float y)
+{
+    player_grav[static_cast<std::size_t>(player)] = -glm::normalize(glm::vec2(x, y)) * g;
+    spawn_ball(player);
+}
+
+nlohmann::json Versus_world::serialize() const
+{
+    nlohmann::json data = nlohmann::json::array();
+    for(auto & b: balls)
+        data.push_back(b.ball.serialize());
+    return {{"balls", data}, {"state", "ONGOING"}};
+}
+
+void Versus_world::save_snapshot(Snapshot & snapshot) const
+{
+    snapshot.balls = balls;
+    snapshot.player_grav = player_grav;
+    snapshot.player_scores = player_scores;
+    snapshot.winner = winner;
+    snapshot.rng = rng;
+}
+
+void Versus_world::restore_snapshot(const Snapshot & snapshot)
+{
+    // element by element, taking any extra balls from the pool, so rolling back doesn't allocate either
+    auto ball = std::begin(balls);
+    for(auto & saved: snapshot.balls)
+    {
+        if(ball != std::end(balls))
+            *ball++ = saved;
+        else
+            add_ball(saved);
+    }
+    while(ball != std::end(balls))
+        remove_ball(ball++);
+
+    player_grav = snapshot.player_grav;
+    player_scores = snapshot.player_scores;
+    winner = snapshot.winner;
+    rng = snapshot.rng;
+}
+
+// FNV-1a over the exact bits of the state, so any difference at all shows up
+std::uint64_t Versus_world::Snapshot::checksum() const
+{
+    std::uint64_t hash = 14695981039346656037ull;
+    auto add = [&hash](const auto & value)
+    {
+        auto bytes = reinterpret_cast<const unsigned char *>(&value);
+        for(std::size_t i = 0; i < sizeof(value); ++i)
+        {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+    };
+
+    for(auto & b: balls)
+    {
+        add(b.ball.get_size());
+        add(b.player);
+        add(b.ball.get_pos().x);
+        add(b.ball.get_pos().y);
+        add(b.ball.get_vel().x);
+        add(b.ball.get_vel().y);
+    }
+    for(auto & grav: player_grav)
+    {
+        add(grav.x);
+        add(grav.y);
+    }
+    add(player_scores);
+    add(winner);
+    add(std::minstd_rand{rng}()); // its next output stands in for its state
+
+    return hash;
+}
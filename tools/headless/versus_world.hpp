@@ -0,0 +1,98 @@
+// Copyright 2022 Matthew Chandler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef INC_2050_VERSUS_WORLD_HPP
+#define INC_2050_VERSUS_WORLD_HPP
+
+#include <array>
+#include <cstdint>
+#include <list>
+#include <random>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+#include <glm/glm.hpp>
+
+#include "ball.hpp"
+
+// two players share the arena, each flinging gravity for their own balls. Balls only merge with their own player's, and the
+// first player to make a 2048 ball wins. Anything random comes from rng, so peers that start from the same seed and apply the
+// same inputs on the same ticks stay in sync. Only headless --versus plays this, through Rollback_session. The app's World and
+// Ball know nothing about players, so this keeps its own balls and physics, and hands its balls to a World to be drawn. Both
+// players' balls are drawn in the same colors
+class Versus_world
+{
+public:
+    struct Player_ball
+    {
+        Ball ball;
+        int player;
+    };
+
+private:
+    // the same arena and physics constants as World's normal game
+    constexpr static float win_size = 512.0f;
+    constexpr static std::size_t num_starting_balls = 2;
+    constexpr static float g = -200.0f;
+    constexpr static float e = 0.5f;
+    constexpr static float wall_damp = 0.9f;
+
+    std::vector<glm::vec4> ball_colors;
+    std::list<Player_ball> balls;
+    std::list<Player_ball> free_balls; // spare nodes, spliced between the two lists, so spawning, merging and rolling back don't allocate
+    constexpr static std::size_t initial_ball_pool = 128;
+
+    std::array<glm::vec2, 2> player_grav {};
+    std::array<int, 2> player_scores {};
+    int winner = -1;
+    std::minstd_rand rng;
+
+    void add_ball(const Player_ball & ball);
+    void remove_ball(std::list<Player_ball>::iterator ball);
+    void spawn_ball(int player);
+
+public:
+    Versus_world();
+
+    void start(std::uint32_t seed); // both peers must start with the same seed
+    void physics_step(float dt); // has no pause, so it can't fall out of sync with the other peer
+    void fling(int player, float x, float y);
+
+    const std::array<int, 2> & get_player_scores() const { return player_scores; }
+    int get_winner() const { return winner; } // -1 until someone wins
+
+    nlohmann::json serialize() const; // the balls, for World::deserialize to draw
+
+    // everything physics_step reads or writes. Saving into an existing snapshot reuses its storage
+    struct Snapshot
+    {
+        std::list<Player_ball> balls;
+        std::array<glm::vec2, 2> player_grav {};
+        std::array<int, 2> player_scores {};
+        int winner = -1;
+        std::minstd_rand rng;
+
+        std::uint64_t checksum() const; // for detecting desyncs between peers
+    };
+    void save_snapshot(Snapshot & snapshot) const;
+    void restore_snapshot(const Snapshot & snapshot);
+};
+
+#endif //INC_2050_VERSUS_WORLD_HPP
@@ -0,0 +1,172 @@
+// Copyright 2022 Matthew Chandler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// build-time tool to generate the signed distance field atlas for ball labels:
+//   sdf_atlas <font.ttf> <output>
+// The result is loaded by Label_batch, so label text can be drawn at any size without FreeType at runtime
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#include "sdf_atlas.hpp"
+
+constexpr unsigned int em_size = 64;
+constexpr int spread = 8;
+
+struct Bitmap
+{
+    int width = 0, height = 0;
+    std::vector<bool> inside;
+};
+
+// distance from each pixel to the nearest pixel on the other side of the glyph's edge, clamped to spread
+std::vector<std::uint8_t> make_sdf(const Bitmap & bmp)
+{
+    std::vector<std::uint8_t> sdf(static_cast<std::size_t>(bmp.width * bmp.height));
+    for(int y = 0; y < bmp.height; ++y)
+    {
+        for(int x = 0; x < bmp.width; ++x)
+        {
+            auto here = bmp.inside[y * bmp.width + x];
+            float min_dist = spread;
+            for(int j = std::max(y - spread, 0); j <= std::min(y + spread, bmp.height - 1); ++j)
+            {
+                for(int i = std::max(x - spread, 0); i <= std::min(x + spread, bmp.width - 1); ++i)
+                {
+                    if(bmp.inside[j * bmp.width + i] != here)
+                        min_dist = std::min(min_dist, std::hypot(static_cast<float>(i - x), static_cast<float>(j - y)));
+                }
+            }
+
+            // pixel centers are half a pixel from the edge between them
+            auto signed_dist = (here ? 1.0f : -1.0f) * (min_dist - 0.5f);
+            auto value = std::clamp(0.5f + 0.5f * signed_dist / spread, 0.0f, 1.0f);
+            sdf[y * bmp.width + x] = static_cast<std::uint8_t>(std::lround(value * 255.0f));
+        }
+    }
+    return sdf;
+}
+
+int main(int argc, char * argv[])
+{
+    if(argc != 3)
+    {
+        std::cerr << "usage: " << argv[0] << " <font.ttf> <output>\n";
+        return EXIT_FAILURE;
+    }
+
+    FT_Library ft_lib;
+    FT_Face face;
+    if(FT_Init_FreeType(&ft_lib) != 0)
+    {
+        std::cerr << "Could not init FreeType\n";
+        return EXIT_FAILURE;
+    }
+    if(FT_New_Face(ft_lib, argv[1], 0, &face) != 0)
+    {
+        std::cerr << "Could not load font: " << argv[1] << '\n';
+        return EXIT_FAILURE;
+    }
+    FT_Set_Pixel_Sizes(face, 0, em_size);
+
+    sdf_atlas::Header header{};
+    std::copy(std::begin(sdf_atlas::magic), std::end(sdf_atlas::magic), header.magic);
+    header.em_size = em_size;
+    header.spread = spread;
+
+    // render each digit with room for the distance field around it, then lay them out in a single row
+    std::vector<std::vector<std::uint8_t>> sdfs;
+    std::vector<Bitmap> bitmaps;
+    int atlas_width = 0, atlas_height = 0;
+    for(std::size_t i = 0; i < sdf_atlas::num_glyphs; ++i)
+    {
+        if(FT_Load_Char(face, '0' + i, FT_LOAD_RENDER) != 0)
+        {
+            std::cerr << "Could not render glyph for '" << static_cast<char>('0' + i) << "'\n";
+            return EXIT_FAILURE;
+        }
+
+        auto & ft_bmp = face->glyph->bitmap;
+        Bitmap bmp;
+        bmp.width = static_cast<int>(ft_bmp.width) + 2 * spread;
+        bmp.height = static_cast<int>(ft_bmp.rows) + 2 * spread;
+        bmp.inside.resize(static_cast<std::size_t>(bmp.width * bmp.height), false);
+        for(unsigned int row = 0; row < ft_bmp.rows; ++row)
+        {
+            for(unsigned int col = 0; col < ft_bmp.width; ++col)
+                bmp.inside[(row + spread) * bmp.width + col + spread] = ft_bmp.buffer[row * ft_bmp.pitch + col] >= 128;
+        }
+
+        auto & glyph = header.glyphs[i];
+        glyph.bearing[0] = static_cast<float>(face->glyph->bitmap_left - spread);
+        glyph.bearing[1] = static_cast<float>(-face->glyph->bitmap_top - spread);
+        glyph.size[0] = static_cast<float>(bmp.width);
+        glyph.size[1] = static_cast<float>(bmp.height);
+        glyph.advance = static_cast<float>(face->glyph->advance.x) / 64.0f;
+
+        atlas_width += bmp.width;
+        atlas_height = std::max(atlas_height, bmp.height);
+
+        sdfs.push_back(make_sdf(bmp));
+        bitmaps.push_back(std::move(bmp));
+    }
+
+    header.width = static_cast<std::uint32_t>(atlas_width);
+    header.height = static_cast<std::uint32_t>(atlas_height);
+
+    std::vector<std::uint8_t> atlas(static_cast<std::size_t>(atlas_width * atlas_height), 0);
+    int x = 0;
+    for(std::size_t i = 0; i < sdf_atlas::num_glyphs; ++i)
+    {
+        auto & bmp = bitmaps[i];
+        for(int row = 0; row < bmp.height; ++row)
+            std::copy_n(std::data(sdfs[i]) + row * bmp.width, bmp.width, std::data(atlas) + row * atlas_width + x);
+
+        auto & glyph = header.glyphs[i];
+        glyph.uv_min[0] = static_cast<float>(x) / atlas_width;
+        glyph.uv_min[1] = 0.0f;
+        glyph.uv_max[0] = static_cast<float>(x + bmp.width) / atlas_width;
+        glyph.uv_max[1] = static_cast<float>(bmp.height) / atlas_height;
+        x += bmp.width;
+    }
+
+    FT_Done_Face(face);
+    FT_Done_FreeType(ft_lib);
+
+    std::ofstream out(argv[2], std::ios::binary);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char *>(std::data(atlas)), static_cast<std::streamsize>(std::size(atlas)));
+    if(!out)
+    {
+        std::cerr << "Could not write " << argv[2] << '\n';
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "wrote " << atlas_width << " x " << atlas_height << " atlas to " << argv[2] << '\n';
+    return EXIT_SUCCESS;
+}